@@ -1,4 +1,6 @@
 #include <iostream>
+#include <fstream>
+#include <utility>
 #include "material.h"
 #include "settings.h"
 #include "evaluation.h"
@@ -7,9 +9,13 @@
 #include "tbprobe.h"
 
 
-
+#ifdef MATERIAL_TABLE_EMBEDDED
+//Defines MaterialTable (built with the default parameter values) and EmbeddedMaterialParameterHash
+#include "materialtable.inc"
+#else
 MaterialTableEntry MaterialTable[MATERIAL_KEY_MAX + 2];
-thread_local MaterialTableEntry UnusualMaterial;
+#endif
+thread_local UnusualMaterialEntry UnusualMaterialTable[UNUSUAL_MATERIAL_TABLE_SIZE];
 
 MaterialKey_t calculateMaterialKey(int * pieceCounts) {
 	MaterialKey_t key = MATERIAL_KEY_OFFSET;
@@ -27,15 +33,21 @@ MaterialKey_t calculateMaterialKey(int nQW, int nQB, int nRW, int nRB, int nBW,
 	return key;
 }
 
-MaterialTableEntry * initUnusual(const Position & pos)
+MaterialTableEntry * probeUnusual(const Position & pos)
 {
-	UnusualMaterial.Evaluation = calculateMaterialEval(pos);
-	UnusualMaterial.EvaluationFunction = &evaluateDefault;
-	UnusualMaterial.Phase = 128;
-	UnusualMaterial.MostValuedPiece = 0;
-	UnusualMaterial.Flags = MaterialSearchFlags::MSF_DEFAULT;
-	if (popcount(pos.ColorBB(WHITE) | pos.ColorBB(BLACK)) <= tablebases::MaxCardinality) UnusualMaterial.Flags |= MaterialSearchFlags::MSF_TABLEBASE_ENTRY;
-	return &UnusualMaterial;
+	const uint64_t key = pos.GetMaterialHash();
+	UnusualMaterialEntry * entry = &UnusualMaterialTable[key & (UNUSUAL_MATERIAL_TABLE_SIZE - 1)];
+	if (entry->Key != key) {
+		entry->Key = key;
+		entry->Evaluation = calculateMaterialEval(pos);
+		entry->EvaluationFunction = &evaluateDefault;
+		entry->Phase = 128;
+		entry->MostValuedPiece = 0;
+		entry->Flags = MaterialSearchFlags::MSF_DEFAULT;
+	}
+	//Tablebases might have been loaded after the entry has been created
+	entry->SetIsTableBaseEntry(popcount(pos.ColorBB(WHITE) | pos.ColorBB(BLACK)) <= tablebases::MaxCardinality);
+	return entry;
 }
 
 Eval calculateMaterialEval(const Position &pos) {
@@ -76,39 +88,38 @@ bool checkImbalance(int deltaQ, int deltaR, int deltaB, int deltaN, int * imb) {
 
 void adjust() {
 	int pieceCounts[10];
-	int pieceCounts2[10];
 	int imbalance[5];
 	bool adjusted = false;
 	while (!adjusted) {
-		for (int nWQ = 0; nWQ <= 1; ++nWQ) {
-			pieceCounts[0] = nWQ;
-			for (int nBQ = 0; nBQ <= 1; ++nBQ) {
-				pieceCounts[1] = nBQ;
-				for (int nWR = 0; nWR <= 2; ++nWR) {
-					pieceCounts[2] = nWR;
-					for (int nBR = 0; nBR <= 2; ++nBR) {
-						pieceCounts[3] = nBR;
-						for (int nWB = 0; nWB <= 2; ++nWB) {
-							pieceCounts[4] = nWB;
-							for (int nBB = 0; nBB <= 2; ++nBB) {
-								pieceCounts[5] = nBB;
-								for (int nWN = 0; nWN <= 2; ++nWN) {
-									pieceCounts[6] = nWN;
-									for (int nBN = 0; nBN <= 2; ++nBN) {
-										pieceCounts[7] = nBN;
-										//Phase_t phase = Phase(nWQ, nBQ, nWR, nBR, nWB, nBB, nWN, nBN);
-										for (int nWP = 0; nWP <= 8; ++nWP) {
-											pieceCounts[8] = nWP;
-											for (int nBP = 0; nBP <= 8; ++nBP) {											
-												pieceCounts[9] = nBP;
+		//Pawn counts have by far the largest material key factors, so they are iterated in the outer loops to keep the entries accessed
+		//by the inner loops close to each other. As the entries with less material (which are compared with) are always visited before,
+		//the result doesn't depend on the loop order
+		for (int nBP = 0; nBP <= 8; ++nBP) {
+			pieceCounts[9] = nBP;
+			for (int nWP = 0; nWP <= 8; ++nWP) {
+				pieceCounts[8] = nWP;
+				for (int nWQ = 0; nWQ <= 1; ++nWQ) {
+					pieceCounts[0] = nWQ;
+					for (int nBQ = 0; nBQ <= 1; ++nBQ) {
+						pieceCounts[1] = nBQ;
+						for (int nWR = 0; nWR <= 2; ++nWR) {
+							pieceCounts[2] = nWR;
+							for (int nBR = 0; nBR <= 2; ++nBR) {
+								pieceCounts[3] = nBR;
+								for (int nWB = 0; nWB <= 2; ++nWB) {
+									pieceCounts[4] = nWB;
+									for (int nBB = 0; nBB <= 2; ++nBB) {
+										pieceCounts[5] = nBB;
+										for (int nWN = 0; nWN <= 2; ++nWN) {
+											pieceCounts[6] = nWN;
+											for (int nBN = 0; nBN <= 2; ++nBN) {
+												pieceCounts[7] = nBN;
 												MaterialKey_t key = calculateMaterialKey(&pieceCounts[0]);
 												for (int i = 0; i < 5; ++i) {
 													imbalance[i] = pieceCounts[2 * i] - pieceCounts[2 * i + 1];
 													if (imbalance[i] > 0) {
-														for (int j = 0; j < 10; ++j) pieceCounts2[j] = pieceCounts[j];
 														for (int count = 0; count < imbalance[i]; ++count) {
-															pieceCounts2[2 * i] = count;
-															MaterialKey_t key2 = calculateMaterialKey(&pieceCounts2[0]);
+															MaterialKey_t key2 = key - materialKeyFactors[2 * i] * (pieceCounts[2 * i] - count);
 															if (MaterialTable[key].Evaluation.egScore < MaterialTable[key2].Evaluation.egScore) {
 																MaterialTable[key].Evaluation = MaterialTable[key2].Evaluation;
 																//printMaterial(&pieceCounts[0]); std::cout << " => "; printMaterial(&pieceCounts2[0]); std::cout << " " << MaterialTable[key].Evaluation.getScore(MaterialTable[key].Phase) << std::endl;
@@ -117,10 +128,8 @@ void adjust() {
 														}
 													}
 													else if (imbalance[i] < 0) {
-														for (int j = 0; j < 10; ++j) pieceCounts2[j] = pieceCounts[j];
 														for (int count = 0; count < -imbalance[i]; ++count) {
-															pieceCounts2[2 * i + 1] = count;
-															MaterialKey_t key2 = calculateMaterialKey(&pieceCounts2[0]);
+															MaterialKey_t key2 = key - materialKeyFactors[2 * i + 1] * (pieceCounts[2 * i + 1] - count);
 															if (MaterialTable[key].Evaluation.egScore > MaterialTable[key2].Evaluation.egScore) {
 																MaterialTable[key].Evaluation = MaterialTable[key2].Evaluation;
 																//printMaterial(&pieceCounts[0]); std::cout << " => "; printMaterial(&pieceCounts2[0]); std::cout << " " << MaterialTable[key].Evaluation.getScore(MaterialTable[key].Phase) << std::endl;
@@ -557,4 +566,73 @@ void InitializeMaterialTable() {
 	MaterialTable[key].EvaluationFunction = &evaluateKQKRP<BLACK>;
 	pieceCounts[BQUEEN] = pieceCounts[WROOK] = pieceCounts[WPAWN] = 0;
 	adjust();
+}
+
+//Hash of all values the material table depends on
+uint64_t MaterialParameterHash() {
+	uint64_t hash = 14695981039346656037ull;
+	auto add = [&hash](int value) { hash = (hash ^ uint64_t(uint32_t(value))) * 1099511628211ull; };
+	auto addEval = [&add](const Eval & e) { add(e.mgScore); add(e.egScore); };
+	for (int i = 0; i < 7; ++i) addEval(settings::parameter.PieceValues[i]);
+	addEval(settings::parameter.BONUS_BISHOP_PAIR);
+	addEval(settings::parameter.SCALE_BISHOP_PAIR_WITH_PAWNS);
+	addEval(settings::parameter.BONUS_BISHOP_PAIR_NO_OPP_MINOR);
+	addEval(settings::parameter.SCALE_EXCHANGE_WITH_MAJORS);
+	addEval(settings::parameter.SCALE_EXCHANGE_WITH_PAWNS);
+	addEval(settings::parameter.IMBALANCE_Q_vs_RN);
+	addEval(settings::parameter.IMBALANCE_Q_vs_RB);
+	add(tablebases::MaxCardinality);
+	return hash;
+}
+
+void InitializeMaterialTableAtStartup() {
+#ifdef MATERIAL_TABLE_EMBEDDED
+	if (MaterialParameterHash() == EmbeddedMaterialParameterHash) return;
+#endif
+	InitializeMaterialTable();
+}
+
+//Evaluation functions referenced by the material table. The generated source refers to them by index
+const std::pair<EvalFunction, const char *> MaterialFunctions[] = {
+	{ &evaluateDefault, "&evaluateDefault" }, { &evaluateFromScratch, "&evaluateFromScratch" }, { &evaluateDraw, "&evaluateDraw" },
+	{ &evaluatePawnEnding, "&evaluatePawnEnding" },
+	{ &easyMate<WHITE>, "&easyMate<WHITE>" }, { &easyMate<BLACK>, "&easyMate<BLACK>" },
+	{ &kpk::EvaluateKPK<WHITE>, "&kpk::EvaluateKPK<WHITE>" }, { &kpk::EvaluateKPK<BLACK>, "&kpk::EvaluateKPK<BLACK>" },
+	{ &evaluateKNBK<WHITE>, "&evaluateKNBK<WHITE>" }, { &evaluateKNBK<BLACK>, "&evaluateKNBK<BLACK>" },
+	{ &evaluateKBPK<WHITE>, "&evaluateKBPK<WHITE>" }, { &evaluateKBPK<BLACK>, "&evaluateKBPK<BLACK>" },
+	{ &evaluateKBPKx<WHITE>, "&evaluateKBPKx<WHITE>" }, { &evaluateKBPKx<BLACK>, "&evaluateKBPKx<BLACK>" },
+	{ &evaluateKQKP<WHITE>, "&evaluateKQKP<WHITE>" }, { &evaluateKQKP<BLACK>, "&evaluateKQKP<BLACK>" },
+	{ &evaluateKRKP<WHITE>, "&evaluateKRKP<WHITE>" }, { &evaluateKRKP<BLACK>, "&evaluateKRKP<BLACK>" },
+	{ &evaluateKNKP<WHITE>, "&evaluateKNKP<WHITE>" }, { &evaluateKNKP<BLACK>, "&evaluateKNKP<BLACK>" },
+	{ &evaluateKBKP<WHITE>, "&evaluateKBKP<WHITE>" }, { &evaluateKBKP<BLACK>, "&evaluateKBKP<BLACK>" },
+	{ &evaluateKNKPx<WHITE>, "&evaluateKNKPx<WHITE>" }, { &evaluateKNKPx<BLACK>, "&evaluateKNKPx<BLACK>" },
+	{ &evaluateKBKPx<WHITE>, "&evaluateKBKPx<WHITE>" }, { &evaluateKBKPx<BLACK>, "&evaluateKBKPx<BLACK>" },
+	{ &evaluateKQPKQ<WHITE>, "&evaluateKQPKQ<WHITE>" }, { &evaluateKQPKQ<BLACK>, "&evaluateKQPKQ<BLACK>" },
+	{ &evaluateKQKRP<WHITE>, "&evaluateKQKRP<WHITE>" }, { &evaluateKQKRP<BLACK>, "&evaluateKQKRP<BLACK>" }
+};
+const int MATERIAL_FUNCTION_COUNT = sizeof(MaterialFunctions) / sizeof(MaterialFunctions[0]);
+
+bool WriteMaterialTable(const std::string & filename) {
+	std::ofstream file(filename);
+	if (!file) return false;
+	file << "//Material table built with the default parameter values - generated by \"nemorino genmaterial\", don't edit" << std::endl;
+	file << "const uint64_t EmbeddedMaterialParameterHash = " << MaterialParameterHash() << "ull;" << std::endl;
+	file << "static constexpr EvalFunction EmbeddedMaterialFunctions[] = {";
+	for (int i = 0; i < MATERIAL_FUNCTION_COUNT; ++i) file << (i ? ", " : " ") << MaterialFunctions[i].second;
+	file << " };" << std::endl;
+	file << "#define M(mg, eg, phase, function, flags, piece) MaterialTableEntry(Eval(mg, eg), phase, EmbeddedMaterialFunctions[function], flags, piece)" << std::endl;
+	file << "MaterialTableEntry MaterialTable[MATERIAL_KEY_MAX + 2] = {" << std::endl;
+	for (int key = 0; key < MATERIAL_KEY_MAX + 2; ++key) {
+		const MaterialTableEntry & entry = MaterialTable[key];
+		int function = 0;
+		while (function < MATERIAL_FUNCTION_COUNT && MaterialFunctions[function].first != entry.EvaluationFunction) ++function;
+		if (function == MATERIAL_FUNCTION_COUNT) {
+			std::cerr << "Material table entry " << key << " uses an unknown evaluation function" << std::endl;
+			return false;
+		}
+		file << "M(" << entry.Evaluation.mgScore << "," << entry.Evaluation.egScore << "," << entry.Phase << "," << function << ","
+			<< int(entry.Flags) << "," << int(entry.MostValuedPiece) << ")," << std::endl;
+	}
+	file << "};" << std::endl << "#undef M" << std::endl;
+	return file.good();
 }
\ No newline at end of file
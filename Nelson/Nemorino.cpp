@@ -8,20 +8,25 @@
 #include "types.h"
 #include "board.h"
 #include "position.h"
+#include "evaluation.h"
 #include "test.h"
 #include "uci.h"
 #include "utils.h"
 #include "test.h"
 
-static bool popcountSupport();
-
 int main(int argc, const char* argv[]) {
-#ifndef NO_POPCOUNT
-	if (!popcountSupport()) {
+#if !defined(NO_POPCOUNT) && !defined(POPCOUNT_DISPATCH)
+	if (!HardwarePopcount) {
 		std::cout << "No Popcount support - Engine does't work on this hardware!" << std::endl;
 		return 0;
 	}
-#endif // !1
+#endif
+	//Options overriding the CPU feature detection (e.g. "nemorino -magic bench") precede all other arguments
+	while (argc > 1 && argv[1] && OverrideHardwareDetection(argv[1])) {
+		--argc;
+		++argv;
+	}
+	InitializeEvaluation();
 	if (argc > 1 && argv[1]) {
 		std::string arg1(argv[1]);
 		if (!arg1.compare("bench4")) {
@@ -33,7 +38,7 @@ int main(int argc, const char* argv[]) {
 			if (argc > 3) test::benchmark(argv[3], depth); else test::benchmark(depth);
 			return 0;
 		}
-		if (!arg1.compare("bench")) {
+		else if (!arg1.compare("bench")) {
 			Initialize();
 			((settings::OptionSpin *)settings::options[settings::OPTION_THREADS])->set(1);
 			settings::parameter.HelperThreads = 0;
@@ -42,6 +47,62 @@ int main(int argc, const char* argv[]) {
 			if (argc > 3) test::benchmark(argv[3], depth); else test::benchmark(depth);
 			return 0;
 		}
+		else if (!arg1.compare("benchnuma")) {
+			Initialize();
+			int threads = std::thread::hardware_concurrency();
+			int depth = 13;
+			if (argc > 2) threads = std::atoi(argv[2]);
+			if (argc > 3) depth = std::atoi(argv[3]);
+			test::benchmarkNuma(threads, depth);
+			return 0;
+		}
+		else if (!arg1.compare("benchttd")) {
+			Initialize();
+			int threads = std::thread::hardware_concurrency();
+			int depth = 12;
+			if (argc > 2) threads = std::atoi(argv[2]);
+			if (argc > 3) depth = std::atoi(argv[3]);
+			test::benchmarkTimeToDepth(threads, depth);
+			return 0;
+		}
+		else if (!arg1.compare("benchreplace")) {
+			Initialize();
+			((settings::OptionSpin *)settings::options[settings::OPTION_THREADS])->set(1);
+			settings::parameter.HelperThreads = 0;
+			int depth = 12;
+			if (argc > 2) depth = std::atoi(argv[2]);
+			if (argc > 3) ((settings::OptionHash *)settings::options[settings::OPTION_HASH])->set(std::atoi(argv[3]));
+			test::benchmarkReplacementPolicy(depth);
+			return 0;
+		}
+		else if (!arg1.compare("benchsliders")) {
+			Initialize();
+			test::benchmarkSliderAttacks(argc > 2 ? std::atoi(argv[2]) : 20000);
+			return 0;
+		}
+		else if (!arg1.compare("ponderlatency")) {
+			Initialize();
+			((settings::OptionSpin *)settings::options[settings::OPTION_THREADS])->set(1);
+			settings::parameter.HelperThreads = 0;
+			test::testPonderHitLatency(argc > 2 ? std::atoi(argv[2]) : 20);
+			return 0;
+		}
+		else if (!arg1.compare("repetition")) {
+			Initialize();
+			return test::testUpcomingRepetition() ? 0 : 1;
+		}
+		else if (!arg1.compare("benchhash")) {
+			Initialize();
+			((settings::OptionSpin *)settings::options[settings::OPTION_THREADS])->set(1);
+			settings::parameter.HelperThreads = 0;
+			int depth = 12;
+			if (argc > 2) depth = std::atoi(argv[2]);
+			std::vector<int> sizes;
+			for (int i = 3; i < argc; ++i) sizes.push_back(std::atoi(argv[i]));
+			if (sizes.empty()) sizes = { 1, 3, 6, 12, 24 };
+			test::benchmarkHashSizes(depth, sizes);
+			return 0;
+		}
 		else if (!arg1.compare("-q")) {
 			std::cout << utils::TexelTuneError(argv, argc) << std::endl;
 			return 0;
@@ -58,6 +119,11 @@ int main(int argc, const char* argv[]) {
 			std::cout << utils::TexelTuneError(std::string(argv[2]), std::string(argv[3])) << std::endl;
 			return 0;
 		}
+		else if (!arg1.compare("genmaterial") && argc > 2) {
+			//Build step: writes the material table with the default parameter values (see Makefile)
+			InitializeMaterialTable();
+			return WriteMaterialTable(argv[2]) ? 0 : 1;
+		}
 	}
 	std::string input = "";
 	Position pos;
@@ -70,22 +136,14 @@ int main(int argc, const char* argv[]) {
 			return 0;
 		}
 		else if (!input.compare(0, 7, "version")) {
-#ifdef NO_POPCOUNT
-			std::cout << VERSION_INFO << "." << BUILD_NUMBER << " (No Popcount)" << std::endl;
-#else
-#ifdef PEXT
-			std::cout << VERSION_INFO << "." << BUILD_NUMBER << " (BMI2)" << std::endl;
-#else
-			std::cout << VERSION_INFO << "." << BUILD_NUMBER << std::endl;
-#endif
-#endif
+			std::cout << VERSION_INFO << "." << BUILD_NUMBER << " (" << HardwareInfo() << ")" << std::endl;
 		}
 		else if (!input.compare(0, 8, "position")) {
 			Initialize();
 			std::string fen;
 			if (input.length() < 10) fen = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
 			else fen = input.substr(9);
-			pos.setFromFEN(fen);
+			if (!pos.setFromFEN(fen)) std::cout << "Invalid position (each side needs exactly one king) - start position is set instead" << std::endl;
 		}
 		else if (!input.compare(0, 6, "perft ")) {
 			Initialize();
@@ -133,33 +191,3 @@ int main(int argc, const char* argv[]) {
 		}
 	}
 }
-
-#ifdef _MSC_VER
-static bool popcountSupport() {
-#ifdef _M_ARM
-	return false;
-#else
-	int cpuInfo[4];
-	int functionId = 0x00000001;
-	__cpuid(cpuInfo, functionId);
-	return (cpuInfo[2] & (1 << 23)) != 0;
-#endif
-}
-#endif // _MSC_VER
-#ifdef __GNUC__
-#ifndef __arm__
-#define cpuid(func,ax,bx,cx,dx)\
-	__asm__ __volatile__ ("cpuid":\
-	"=a" (ax), "=b" (bx), "=c" (cx), "=d" (dx) : "a" (func));
-#endif
-static bool popcountSupport() {
-#ifdef __arm__
-	return false;
-#else
-	int cpuInfo[4];
-	cpuid(0x00000001, cpuInfo[0], cpuInfo[1], cpuInfo[2], cpuInfo[3]);
-	return (cpuInfo[2] & (1 << 23)) != 0;
-#endif
-}
-#endif // __GNUC__
-
@@ -1,4 +1,5 @@
 #include <vector>
+#include <algorithm>
 #include <stdio.h>
 #include <iostream>
 #include <chrono>
@@ -12,6 +13,85 @@
 
 bool Chess960 = false;
 
+#if defined(_MSC_VER) && !defined(_M_ARM)
+static void cpuid(int info[4], int function) { __cpuidex(info, function, 0); }
+#elif defined(__GNUC__) && !defined(__arm__)
+static void cpuid(int info[4], int function) {
+	__asm__ __volatile__ ("cpuid" : "=a" (info[0]), "=b" (info[1]), "=c" (info[2]), "=d" (info[3]) : "a" (function), "c" (0));
+}
+#else
+static void cpuid(int info[4], int function) { info[0] = info[1] = info[2] = info[3] = 0; }
+#endif
+
+static bool cpuHasPopcnt() {
+	int info[4];
+	cpuid(info, 1);
+	return (info[2] & (1 << 23)) != 0;
+}
+
+static bool cpuHasBMI2() {
+	int info[4];
+	cpuid(info, 0);
+	if (info[0] < 7) return false;
+	cpuid(info, 7);
+	return (info[1] & (1 << 8)) != 0;
+}
+
+//AMD CPUs before Zen 3 execute PEXT in microcode with a latency depending on the mask, magic bitboards are faster there
+static bool cpuHasFastPext() {
+	if (!cpuHasBMI2()) return false;
+	int info[4];
+	cpuid(info, 0);
+	if (info[1] != 0x68747541) return true; //"Auth"enticAMD
+	cpuid(info, 1);
+	int family = (info[0] >> 8) & 0xF;
+	if (family == 0xF) family += (info[0] >> 20) & 0xFF;
+	return family >= 0x19;
+}
+
+#ifdef NO_POPCOUNT
+bool HardwarePopcount = false;
+#else
+bool HardwarePopcount = cpuHasPopcnt();
+#endif
+#if defined(USE_PEXT)
+bool HardwarePext = true;
+#elif defined(PEXT_DISPATCH)
+bool HardwarePext = cpuHasFastPext();
+#else
+bool HardwarePext = false;
+#endif
+
+bool OverrideHardwareDetection(const std::string& argument) {
+	if (!argument.compare("-nopopcnt")) {
+#ifdef POPCOUNT_DISPATCH
+		HardwarePopcount = false;
+#endif
+	}
+	else if (!argument.compare("-magic")) {
+#ifdef PEXT_DISPATCH
+		HardwarePext = false;
+#endif
+	}
+	else if (!argument.compare("-pext")) {
+#ifdef PEXT_DISPATCH
+		HardwarePext = cpuHasBMI2();
+#endif
+	}
+	else return false;
+	return true;
+}
+
+std::string HardwareInfo() {
+	std::stringstream ss;
+#ifdef COMPACT_SLIDERS
+	ss << "popcount: " << (HardwarePopcount ? "hardware" : "software") << ", sliders: compact";
+#else
+	ss << "popcount: " << (HardwarePopcount ? "hardware" : "software") << ", sliders: " << (HardwarePext ? "pext" : "magic");
+#endif
+	return ss.str();
+}
+
 Bitboard InitialKingSquareBB[2];
 Square InitialKingSquare[2];
 Bitboard InitialRookSquareBB[4];
@@ -225,6 +305,46 @@ void InitializeRaysBySquares() {
 //
 //}
 
+uint64_t CuckooKeys[CUCKOO_SIZE];
+Move CuckooMoves[CUCKOO_SIZE];
+void InitializeCuckoo() {
+	std::fill_n(CuckooKeys, CUCKOO_SIZE, 0ull);
+	std::fill_n(CuckooMoves, CUCKOO_SIZE, MOVE_NONE);
+	int count = 0;
+	for (int pt = QUEEN; pt <= KING; ++pt) {
+		if (pt == PAWN) continue;
+		for (int c = WHITE; c <= BLACK; ++c) {
+			Piece piece = GetPiece(PieceType(pt), Color(c));
+			for (int s1 = 0; s1 < 64; ++s1) {
+				Bitboard targets;
+				switch (pt) {
+				case QUEEN: targets = RookTargets(Square(s1), EMPTY) | BishopTargets(Square(s1), EMPTY); break;
+				case ROOK: targets = RookTargets(Square(s1), EMPTY); break;
+				case BISHOP: targets = BishopTargets(Square(s1), EMPTY); break;
+				case KNIGHT: targets = KnightAttacks[s1]; break;
+				default: targets = KingAttacks[s1]; break;
+				}
+				for (int s2 = s1 + 1; s2 < 64; ++s2) {
+					if (!(targets & ToBitboard(s2))) continue;
+					Move move = createMove(s1, s2);
+					uint64_t key = ZobristKeys[piece][s1] ^ ZobristKeys[piece][s2] ^ ZobristMoveColor;
+					//Insert key, if the slot is occupied push the old entry to its alternative slot
+					int i = CuckooH1(key);
+					while (true) {
+						std::swap(CuckooKeys[i], key);
+						std::swap(CuckooMoves[i], move);
+						if (move == MOVE_NONE) break;
+						i = (i == CuckooH1(key)) ? CuckooH2(key) : CuckooH1(key);
+					}
+					++count;
+				}
+			}
+		}
+	}
+	assert(count == 3668);
+	(void)count;
+}
+
 //ShadowedFields[s1][s2] contains the fields which are seen from s1 shadowed by a piece on s2
 //f.e. ShadowedFields[A1][F1] = contains G1 and H1
 Bitboard ShadowedFields[64][64];
@@ -314,7 +434,59 @@ void InitializeShadowedFields()
 	}
 }
 
-#ifdef USE_PEXT
+Bitboard FillUpAttacks[8][64];
+Bitboard AFileAttacks[8][64];
+Bitboard RankMaskEx[64];
+Bitboard DiagonalMaskEx[64];
+Bitboard AntiDiagonalMaskEx[64];
+
+void InitializeCompactSliders() {
+	//Attacks along a line from the slider's file, given the occupancy of files b - g
+	for (int file = 0; file < 8; ++file) {
+		for (int occupancy = 0; occupancy < 64; ++occupancy) {
+			int occupied = occupancy << 1;
+			int attacks = 0;
+			for (int f = file + 1; f < 8; ++f) {
+				attacks |= 1 << f;
+				if (occupied & (1 << f)) break;
+			}
+			for (int f = file - 1; f >= 0; --f) {
+				attacks |= 1 << f;
+				if (occupied & (1 << f)) break;
+			}
+			FillUpAttacks[file][occupancy] = A_FILE * attacks;
+		}
+	}
+	//Attacks along the A-File, the index is calculated the same way as in RookTargetsCompact
+	for (int rank = 0; rank < 8; ++rank) {
+		for (int occupancy = 0; occupancy < 64; ++occupancy) {
+			Bitboard occupied = 0;
+			for (int r = 1; r < 7; ++r) if (occupancy & (1 << (r - 1))) occupied |= 1ull << (8 * r);
+			Bitboard attacks = 0;
+			for (int r = rank + 1; r < 8; ++r) {
+				attacks |= 1ull << (8 * r);
+				if (occupied & (1ull << (8 * r))) break;
+			}
+			for (int r = rank - 1; r >= 0; --r) {
+				attacks |= 1ull << (8 * r);
+				if (occupied & (1ull << (8 * r))) break;
+			}
+			AFileAttacks[rank][(occupied * DIAGONAL_C2_H7) >> 58] = attacks;
+		}
+	}
+	for (int square = 0; square < 64; ++square) {
+		int rank = square >> 3;
+		int file = square & 7;
+		RankMaskEx[square] = RANKS[rank] & ~(1ull << square);
+		DiagonalMaskEx[square] = AntiDiagonalMaskEx[square] = 0;
+		for (int r = rank + 1, f = file + 1; r < 8 && f < 8; ++r, ++f) DiagonalMaskEx[square] |= 1ull << (8 * r + f);
+		for (int r = rank - 1, f = file - 1; r >= 0 && f >= 0; --r, --f) DiagonalMaskEx[square] |= 1ull << (8 * r + f);
+		for (int r = rank + 1, f = file - 1; r < 8 && f >= 0; ++r, --f) AntiDiagonalMaskEx[square] |= 1ull << (8 * r + f);
+		for (int r = rank - 1, f = file + 1; r >= 0 && f < 8; --r, ++f) AntiDiagonalMaskEx[square] |= 1ull << (8 * r + f);
+	}
+}
+
+#if defined(USE_PEXT) || defined(PEXT_DISPATCH)
 Bitboard ROOK_MASKS[64];
 Bitboard BISHOP_MASKS[64];
 int ROOK_OFFSETS[64];
@@ -478,7 +650,8 @@ void initializePext() {
 	initializePextMasks();
 	initializePextAttacks();
 }
-#else
+#endif
+#ifndef USE_PEXT
 
 int BishopShift[] = { 59, 60, 59, 59, 59, 59, 60, 59, 60, 60, 59, 59, 59, //a1 - e2
 59, 60, 60, 60, 60, 57, 57, 57, 57, 60, 60, 59, 59, 57, 55, 55, 57, //f2 - f4
@@ -719,12 +892,17 @@ void Initialize(bool quiet) {
 	//	InitializeAffectedBy();
 	InitializeSlidingAttacksTo();
 	InitializeRaysBySquares();
-#ifdef USE_PEXT
+	InitializeCompactSliders();
+#if defined(COMPACT_SLIDERS)
+#elif defined(USE_PEXT)
 	initializePext();
+#elif defined(PEXT_DISPATCH)
+	if (HardwarePext) initializePext(); else InitializeMagic();
 #else
 	InitializeMagic();
 #endif
-	InitializeMaterialTable();
+	InitializeCuckoo();
+	InitializeMaterialTableAtStartup();
 	InitializeShadowedFields();
 	pawn::initialize();
 	tt::InitializeTranspositionTable();
@@ -76,13 +76,14 @@ const uint8_t PawnShieldIndex[64] = {
 	2, 1, 0, 8, 8, 0, 1, 2,
 	8, 8, 8, 8, 8, 8, 8, 8 };
 
-#ifdef USE_PEXT
+#if defined(USE_PEXT) || defined(PEXT_DISPATCH)
 extern Bitboard ROOK_MASKS[64];
 extern Bitboard BISHOP_MASKS[64];
 extern int ROOK_OFFSETS[64];
 extern int BISHOP_OFFSETS[64];
 extern Bitboard ATTACKS[107648];
-#else
+#endif
+#ifndef USE_PEXT
 extern Bitboard MagicMovesRook[88576];
 extern Bitboard MagicMovesBishop[4800];
 extern int BishopShift[64];
@@ -94,6 +95,13 @@ extern int IndexOffsetBishop[64];
 extern uint64_t RookMagics[64];
 extern uint64_t BishopMagics[64];
 #endif
+const Bitboard DIAGONAL_C2_H7 = 0x0080402010080400;
+//Tables for the compact (kindergarten) slider attacks
+extern Bitboard FillUpAttacks[8][64]; //[file][inner occupancy of the line] => attacked files on all ranks
+extern Bitboard AFileAttacks[8][64]; //[rank][inner occupancy of A-File] => attacks on A-File
+extern Bitboard RankMaskEx[64];
+extern Bitboard DiagonalMaskEx[64];
+extern Bitboard AntiDiagonalMaskEx[64];
 extern Bitboard InBetweenFields[64][64];
 extern Bitboard RaysBySquares[64][64];
 extern Bitboard ShadowedFields[64][64];
@@ -133,6 +141,20 @@ inline Bitboard ToBitboard(Square square) { return SquareBB[square]; }
 inline Bitboard ToBitboard(int square) { return SquareBB[square]; }
 
 void Initialize(bool quiet = false);
+//Initialization of the slider attack tables (all called by Initialize for the tables in use)
+void InitializeCompactSliders();
+#if defined(USE_PEXT) || defined(PEXT_DISPATCH)
+void initializePext();
+#endif
+#ifndef USE_PEXT
+void InitializeMagic();
+#endif
+//Initialization of the cuckoo tables (needs the slider attack tables)
+void InitializeCuckoo();
+//Handles the command line options overriding the CPU feature detection (-magic, -pext, -nopopcnt), returns false for other arguments
+bool OverrideHardwareDetection(const std::string& argument);
+//Describes the popcount and slider attack implementations in use
+std::string HardwareInfo();
 
 inline std::string toString(Move move) {
 	Square fromSquare = from(move);
@@ -174,32 +196,74 @@ inline Bitboard squaresOfSameColor(Square s) {
 	return (DARKSQUARES & ToBitboard(s)) ? DARKSQUARES : ~DARKSQUARES;
 }
 
-#ifdef USE_PEXT
+#if defined(USE_PEXT) || defined(PEXT_DISPATCH)
 
-inline Bitboard RookTargets(Square rookSquare, Bitboard occupied) {
+inline Bitboard RookTargetsPext(Square rookSquare, Bitboard occupied) {
 	return ATTACKS[ROOK_OFFSETS[rookSquare]
 		+ pext(occupied, ROOK_MASKS[rookSquare])];
 }
 
-inline Bitboard BishopTargets(Square bishopSquare, Bitboard occupied) {
+inline Bitboard BishopTargetsPext(Square bishopSquare, Bitboard occupied) {
 	return ATTACKS[BISHOP_OFFSETS[bishopSquare]
 		+ pext(occupied, BISHOP_MASKS[bishopSquare])];
 }
 
-#else
+#endif
+#ifndef USE_PEXT
 
-inline Bitboard RookTargets(Square rookSquare, Bitboard occupied) {
+inline Bitboard RookTargetsMagic(Square rookSquare, Bitboard occupied) {
 	int index = (int)(((OccupancyMaskRook[rookSquare] & occupied) * RookMagics[rookSquare]) >> RookShift[rookSquare]);
 	return MagicMovesRook[index + IndexOffsetRook[rookSquare]];
 }
 
-inline Bitboard BishopTargets(Square bishopSquare, Bitboard occupied) {
+inline Bitboard BishopTargetsMagic(Square bishopSquare, Bitboard occupied) {
 	int index = (int)(((OccupancyMaskBishop[bishopSquare] & occupied) * BishopMagics[bishopSquare]) >> BishopShift[bishopSquare]);
 	return MagicMovesBishop[index + IndexOffsetBishop[bishopSquare]];
 }
 
 #endif
 
+//Kindergarten bitboards: the inner occupancy of a line is collected by a multiplication into a 6 bit index. One table per
+//direction type is shared by all squares, which needs about 10 KB instead of ~800 KB for magic or PEXT tables
+inline Bitboard RookTargetsCompact(Square rookSquare, Bitboard occupied) {
+	int file = rookSquare & 7;
+	Bitboard rankAttacks = FillUpAttacks[file][((RankMaskEx[rookSquare] & occupied) * B_FILE) >> 58] & RankMaskEx[rookSquare];
+	Bitboard fileOccupancy = A_FILE & (occupied >> file);
+	return rankAttacks | (AFileAttacks[rookSquare >> 3][(fileOccupancy * DIAGONAL_C2_H7) >> 58] << file);
+}
+
+inline Bitboard BishopTargetsCompact(Square bishopSquare, Bitboard occupied) {
+	int file = bishopSquare & 7;
+	return (FillUpAttacks[file][((DiagonalMaskEx[bishopSquare] & occupied) * B_FILE) >> 58] & DiagonalMaskEx[bishopSquare])
+		| (FillUpAttacks[file][((AntiDiagonalMaskEx[bishopSquare] & occupied) * B_FILE) >> 58] & AntiDiagonalMaskEx[bishopSquare]);
+}
+
+inline Bitboard RookTargets(Square rookSquare, Bitboard occupied) {
+#if defined(COMPACT_SLIDERS)
+	return RookTargetsCompact(rookSquare, occupied);
+#elif defined(USE_PEXT)
+	return RookTargetsPext(rookSquare, occupied);
+#else
+#ifdef PEXT_DISPATCH
+	if (HardwarePext) return RookTargetsPext(rookSquare, occupied);
+#endif
+	return RookTargetsMagic(rookSquare, occupied);
+#endif
+}
+
+inline Bitboard BishopTargets(Square bishopSquare, Bitboard occupied) {
+#if defined(COMPACT_SLIDERS)
+	return BishopTargetsCompact(bishopSquare, occupied);
+#elif defined(USE_PEXT)
+	return BishopTargetsPext(bishopSquare, occupied);
+#else
+#ifdef PEXT_DISPATCH
+	if (HardwarePext) return BishopTargetsPext(bishopSquare, occupied);
+#endif
+	return BishopTargetsMagic(bishopSquare, occupied);
+#endif
+}
+
 inline Bitboard QueenTargets(Square queenSquare, Bitboard occupied) {
 	return RookTargets(queenSquare, occupied) | BishopTargets(queenSquare, occupied);
 }
@@ -251,6 +315,18 @@ inline int ChebishevDistance(Square sq1, Square sq2) {
 
 template<Color COLOR_OF_PAWN> inline Square ConversionSquare(Square pawnSquare) { if (COLOR_OF_PAWN == WHITE) return Square(56 + (pawnSquare & 7)); else return Square(pawnSquare & 7); }
 
+//Mirrors a square given from white's perspective to the perspective of COLOR
+template<Color COLOR> inline Square RelativeSquare(Square square) { if (COLOR == WHITE) return square; else return Square(square ^ 56); }
+
+//Shifts all pawns of COLOR one rank forward
+template<Color COLOR_OF_PAWN> inline Bitboard PawnPush(Bitboard pawns) { if (COLOR_OF_PAWN == WHITE) return pawns << 8; else return pawns >> 8; }
+
+//Squares attacked by the pawns of COLOR
+template<Color COLOR_OF_PAWN> inline Bitboard PawnTargets(Bitboard pawns) {
+	if (COLOR_OF_PAWN == WHITE) return ((pawns << 9) & NOT_A_FILE) | ((pawns << 7) & NOT_H_FILE);
+	else return ((pawns >> 9) & NOT_H_FILE) | ((pawns >> 7) & NOT_A_FILE);
+}
+
 template<Color COLOR_OF_PAWN> inline uint8_t MovesToConversion(Square pawnSquare) {
 	if (COLOR_OF_PAWN == BLACK) return (uint8_t)std::min(pawnSquare >> 3, 5); else return (uint8_t)std::min((pawnSquare >> 3) ^ 7, 5);
 }
@@ -541,3 +617,11 @@ const uint64_t ZC8 = 0x1EF6E6DBB1961EC9ull;
 const uint64_t ZobristCastles[] = { 0, ZC1, ZC2, ZC1 ^ ZC2, ZC4, ZC4 ^ ZC1, ZC4 ^ ZC2, ZC4 ^ ZC1 ^ ZC2, ZC8, ZC8 ^ ZC1, ZC8 ^ ZC2, ZC8 ^ ZC2 ^ ZC1, ZC8 ^ ZC4, ZC8 ^ ZC4 ^ ZC1, ZC8 ^ ZC4 ^ ZC2, ZC8 ^ ZC4 ^ ZC2 ^ ZC1 };
 const uint64_t ZobristEnPassant[] = { 0x70CC73D90BC26E24ull, 0xE21A6B35DF0C3AD7ull, 0x003A93D8B2806962ull, 0x1C99DED33CB890A1ull, 0xCF3145DE0ADD4289ull, 0xD0E4427A5514FB72ull, 0x77C621CC9FB3A483ull, 0x67A34DAC4356550Bull };
 const uint64_t ZobristMoveColor = 0xF8D626AAAF278509ull;
+
+//Cuckoo tables containing the zobrist key differences (including side to move) of all reversible (non-pawn) moves on an empty board.
+//A key is stored either at CuckooH1(key) or at CuckooH2(key), the related move is stored at the same index in CuckooMoves
+const int CUCKOO_SIZE = 8192;
+extern uint64_t CuckooKeys[CUCKOO_SIZE];
+extern Move CuckooMoves[CUCKOO_SIZE];
+inline int CuckooH1(uint64_t key) { return int(key & (CUCKOO_SIZE - 1)); }
+inline int CuckooH2(uint64_t key) { return int((key >> 16) & (CUCKOO_SIZE - 1)); }
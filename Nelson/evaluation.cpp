@@ -8,7 +8,7 @@
 
 Eval Contempt(settings::parameter.Contempt, settings::parameter.Contempt / 2);
 
-Value evaluateDefault(const Position& pos) {
+static inline Value evaluateDefaultImpl(const Position& pos) {
 	Evaluation result;
 	result.Material = pos.GetMaterialTableEntry()->Evaluation;
 	result.Mobility = evaluateMobility(pos);
@@ -20,6 +20,24 @@ Value evaluateDefault(const Position& pos) {
 	return result.GetScore(pos);
 }
 
+#ifdef POPCOUNT_DISPATCH
+//The whole evaluation is inlined into both variants, so that all popcounts within the POPCNT variant are done by the instruction
+TARGET_POPCNT __attribute__((flatten)) static Value evaluateDefaultPopcnt(const Position& pos) { return evaluateDefaultImpl(pos); }
+__attribute__((flatten)) static Value evaluateDefaultGeneric(const Position& pos) { return evaluateDefaultImpl(pos); }
+
+static EvalFunction evaluateDefaultSelected = &evaluateDefaultGeneric;
+
+void InitializeEvaluation() {
+	evaluateDefaultSelected = HardwarePopcount ? &evaluateDefaultPopcnt : &evaluateDefaultGeneric;
+}
+
+Value evaluateDefault(const Position& pos) { return evaluateDefaultSelected(pos); }
+#else
+void InitializeEvaluation() { }
+
+Value evaluateDefault(const Position& pos) { return evaluateDefaultImpl(pos); }
+#endif
+
 std::string printDefaultEvaluation(const Position& pos) {
 	std::stringstream ss;
 	Evaluation result;
@@ -49,6 +67,60 @@ Value evaluateDraw(const Position& pos) {
 	return Contempt.getScore(pos.GetMaterialTableEntry()->Phase) * (1 - 2 * pos.GetSideToMove());;
 }
 
+//Pawn shelter and pawn storm terms for a castled king (from white's point of view). They only depend on the pawn structure
+//and the king's square
+template <Color COL> static Eval evaluateShelterStorm(const Position& pos) {
+	const Color OTHER = Color(COL ^ 1);
+	const Square kingSquare = pos.KingSquare(COL);
+	const Bitboard bbOwn = pos.PieceBB(PAWN, COL);
+	const Bitboard kingRing = pos.PieceBB(KING, COL) | KingAttacks[kingSquare];
+	Bitboard kingZone = (pos.PieceBB(KING, COL) & (COL == WHITE ? RANK1 : RANK8)) != EMPTY ? kingRing | PawnPush<COL>(kingRing) : kingRing;
+	if ((kingSquare & 7) == 7) kingZone |= kingRing >> 1; else if ((kingSquare & 7) == 0) kingZone |= kingRing << 1;
+	Bitboard bbShelter = bbOwn & ((kingRing & ShelterPawns2ndRank) | (kingZone & ShelterPawns3rdRank) | (PawnPush<COL>(kingZone) & ShelterPawns4thRank));
+	Eval shelter;
+	while (bbShelter) {
+		Square s = lsb(bbShelter);
+		shelter += settings::parameter.PAWN_SHELTER[PawnShieldIndex[s]];
+		bbShelter &= bbShelter - 1;
+	}
+	Eval pawnStorm = shelter;
+#ifndef NDEBUG
+	Eval shelterOld = settings::parameter.PAWN_SHELTER_2ND_RANK * popcount(bbOwn & kingRing & ShelterPawns2ndRank);
+	shelterOld += settings::parameter.PAWN_SHELTER_3RD_RANK * popcount(bbOwn & kingZone & ShelterPawns3rdRank);
+	shelterOld += settings::parameter.PAWN_SHELTER_4TH_RANK * popcount(bbOwn & PawnPush<COL>(kingZone) & ShelterPawns4thRank);
+	assert(shelterOld.mgScore == shelter.mgScore && shelterOld.egScore == shelter.egScore);
+#endif
+	const bool kingSide = (kingSquare & 7) > 3;
+	Bitboard pawnStormArea = kingSide ? bbKINGSIDE : bbQUEENSIDE;
+	Bitboard stormPawns = pos.PieceBB(PAWN, OTHER) & pawnStormArea & (COL == WHITE ? HALF_OF_WHITE | RANK5 : HALF_OF_BLACK | RANK4);
+	const Bitboard blockers = pos.PieceTypeBB(PAWN) | pos.PieceBB(KING, COL);
+	while (stormPawns) {
+		const Square sq = lsb(stormPawns);
+		const Bitboard stormPawn = isolateLSB(stormPawns);
+		stormPawns &= stormPawns - 1;
+		const int rank = relativeRank(COL, sq >> 3);
+		if (PawnTargets<OTHER>(stormPawn) & bbOwn) {
+			if (rank > 1 && rank < 4) pawnStorm -= Eval(settings::parameter.BONUS_LEVER_ON_KINGSIDE, 0); //lever
+		}
+		else if (PawnPush<OTHER>(stormPawn) & blockers) continue;
+		pawnStorm -= settings::parameter.PAWN_STORM[rank - 1];
+	}
+	return COL == WHITE ? pawnStorm : -pawnStorm;
+}
+
+//Shelter/storm terms are cached in the pawn hash entry per king file (tagged with the king's square, as for a king on the
+//2nd rank the king ring differs) and are only calculated on first use
+template <Color COL> inline Eval shelterStorm(const Position& pos) {
+	pawn::Entry * pawnEntry = pos.GetPawnEntry();
+	const Square kingSquare = pos.KingSquare(COL);
+	const int file = kingSquare & 7;
+	if (pawnEntry->shelterStormSquare[COL][file] != kingSquare) {
+		pawnEntry->shelterStorm[COL][file] = evaluateShelterStorm<COL>(pos);
+		pawnEntry->shelterStormSquare[COL][file] = uint8_t(kingSquare);
+	}
+	return pawnEntry->shelterStorm[COL][file];
+}
+
 Eval evaluateKingSafety(const Position& pos) {
 	if (pos.GetMaterialTableEntry()->Phase > PHASE_LIMIT_ENDGAME) return EVAL_ZERO;
 	Eval result;
@@ -118,75 +190,9 @@ Eval evaluateKingSafety(const Position& pos) {
 		}
 	}
 	result.mgScore += attackVals[BLACK] - attackVals[WHITE];
-	Bitboard bbWhite = pos.PieceBB(PAWN, WHITE);
-	Bitboard bbBlack = pos.PieceBB(PAWN, BLACK);
-	//Pawn shelter/storm
-	Eval pawnStorm;
-	if (pos.PieceBB(KING, WHITE) & SaveSquaresForKing & HALF_OF_WHITE) { //Bonus only for castled king
-		Bitboard bbShelter = bbWhite & ((kingRing[0] & ShelterPawns2ndRank) | (kingZone[0] & ShelterPawns3rdRank) | ((kingZone[0] << 8) & ShelterPawns4thRank));
-		Eval shelter;
-		while (bbShelter) {
-			Square s = lsb(bbShelter);
-			shelter += settings::parameter.PAWN_SHELTER[PawnShieldIndex[s]];
-			bbShelter &= bbShelter - 1;
-		}
-		pawnStorm += shelter;
-#ifndef NDEBUG
-		Eval shelterOld = settings::parameter.PAWN_SHELTER_2ND_RANK * popcount(bbWhite & kingRing[0] & ShelterPawns2ndRank);
-		shelterOld += settings::parameter.PAWN_SHELTER_3RD_RANK * popcount(bbWhite & kingZone[0] & ShelterPawns3rdRank);
-		shelterOld += settings::parameter.PAWN_SHELTER_4TH_RANK * popcount(bbWhite & (kingZone[0] << 8) & ShelterPawns4thRank);
-		assert(shelterOld.mgScore == shelter.mgScore && shelterOld.egScore == shelter.egScore);
-#endif
-		const bool kingSide = (pos.KingSquare(WHITE) & 7) > 3;
-		Bitboard pawnStormArea = kingSide ? bbKINGSIDE : bbQUEENSIDE;
-		Bitboard stormPawns = pos.PieceBB(PAWN, BLACK) & pawnStormArea & (HALF_OF_WHITE | RANK5);
-		while (stormPawns) {
-			const Square sq = lsb(stormPawns);
-			stormPawns &= stormPawns - 1;
-			if ((pos.GetAttacksFrom(sq) & pos.PieceBB(PAWN, WHITE)) != EMPTY) {
-				int rank = sq >> 3;
-				if (rank > 1 && rank < 4) pawnStorm -= Eval(settings::parameter.BONUS_LEVER_ON_KINGSIDE,0); //lever
-			}
-			else {
-				const Piece blocker = pos.GetPieceOnSquare(static_cast<Square>(sq - 8));
-				if (blocker == WKING || GetPieceType(blocker) == PAWN) continue;
-			}
-			pawnStorm -= settings::parameter.PAWN_STORM[(sq >> 3) - 1];
-		}
-	}
-	if (pos.PieceBB(KING, BLACK) & SaveSquaresForKing & HALF_OF_BLACK) {
-		Bitboard bbShelter = bbBlack & ((kingRing[1] & ShelterPawns2ndRank) | (kingZone[1] & ShelterPawns3rdRank) | ((kingZone[1] >> 8) & ShelterPawns4thRank));
-		Eval shelter;
-		while (bbShelter) {
-			Square s = lsb(bbShelter);
-			shelter += settings::parameter.PAWN_SHELTER[PawnShieldIndex[s]];
-			bbShelter &= bbShelter - 1;
-		}
-		pawnStorm -= shelter;
-#ifndef NDEBUG
-		Eval shelterOld = settings::parameter.PAWN_SHELTER_2ND_RANK * popcount(bbBlack & kingRing[1] & ShelterPawns2ndRank);
-		shelterOld += settings::parameter.PAWN_SHELTER_3RD_RANK * popcount(bbBlack & kingZone[1] & ShelterPawns3rdRank);
-		shelterOld += settings::parameter.PAWN_SHELTER_4TH_RANK * popcount(bbBlack & (kingZone[1] >> 8) & ShelterPawns4thRank);
-		assert(shelterOld.mgScore == shelter.mgScore && shelterOld.egScore == shelter.egScore);
-#endif
-		const bool kingSide = (pos.KingSquare(BLACK) & 7) > 3;
-		Bitboard pawnStormArea = kingSide ? bbKINGSIDE : bbQUEENSIDE;
-		Bitboard stormPawns = pos.PieceBB(PAWN, WHITE) & pawnStormArea & (HALF_OF_BLACK | RANK4);
-		while (stormPawns) {
-			const Square sq = lsb(stormPawns);
-			stormPawns &= stormPawns - 1;
-			if ((pos.GetAttacksFrom(sq) & pos.PieceBB(PAWN, BLACK)) != EMPTY) {
-				int rank = sq >> 3;
-				if (rank > 3 && rank < 6) pawnStorm += Eval(settings::parameter.BONUS_LEVER_ON_KINGSIDE, 0); //lever
-			}
-			else {
-				const Piece blocker = pos.GetPieceOnSquare(static_cast<Square>(sq + 8));
-				if (blocker == BKING || GetPieceType(blocker) == PAWN) continue;
-			}
-			pawnStorm += settings::parameter.PAWN_STORM[6 - (sq >> 3)];
-		}
-	}
-	result += pawnStorm;
+	//Pawn shelter/storm (bonus only for castled king)
+	if (pos.PieceBB(KING, WHITE) & SaveSquaresForKing & HALF_OF_WHITE) result += shelterStorm<WHITE>(pos);
+	if (pos.PieceBB(KING, BLACK) & SaveSquaresForKing & HALF_OF_BLACK) result += shelterStorm<BLACK>(pos);
 	return result;
 }
 
@@ -6,6 +6,8 @@
 #include "bbEndings.h"
 
 int scaleEG(const Position& pos);
+//Selects the implementation of evaluateDefault matching the CPU (with or without POPCNT instruction)
+void InitializeEvaluation();
 
 extern Eval Contempt;
 
@@ -7,24 +7,51 @@
 #endif
 #endif
 #include "stdlib.h"
+#include <vector>
+#include <algorithm>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 #include "search.h"
+#include "utils.h"
 
 namespace pawn {
 
-	Entry Table[PAWN_TABLE_SIZE];
+	Table DefaultTable(4);
+	thread_local Table * threadTable = &DefaultTable;
 
 	void initialize() {
-		clear();
+		DefaultTable.resize(settings::options.getInt(settings::OPTION_PAWN_HASH));
 	}
 
 	void clear() {
-		std::memset(Table, 0, PAWN_TABLE_SIZE * sizeof(Entry));
+		DefaultTable.clear();
+	}
+
+	void Table::resize(int size) {
+		if (size == sizeMB && entries != nullptr) return;
+		delete[] entries;
+		sizeMB = size;
+		//Use the largest power of 2 number of entries fitting into the requested size
+		uint64_t count = 1;
+		while (2 * count * sizeof(Entry) <= (uint64_t(size) << 20)) count *= 2;
+		entries = new Entry[count];
+		mask = count - 1;
+		clear();
+	}
+
+	void Table::clear() {
+		if (entries) std::fill(entries, entries + mask + 1, Entry());
 	}
 
-	Entry * probe(const Position &pos) {
-		Entry * result = &Table[pos.GetPawnKey() & (PAWN_TABLE_SIZE - 1)];
+	Entry * Table::probe(const Position &pos) {
+		Entry * result = &entries[pos.GetPawnKey() & mask];
 		if (result->Key == pos.GetPawnKey()) return result;
 		result->Score = Eval(0);
+		std::memset(result->shelterStormSquare, 0xFF, sizeof(result->shelterStormSquare));
 		Bitboard bbWhite = pos.PieceBB(PAWN, WHITE);
 		Bitboard bbBlack = pos.PieceBB(PAWN, BLACK);
 		Bitboard bbFilesWhite = FileFill(bbWhite);
@@ -117,66 +144,212 @@ namespace pawn {
 	}
 }
 
+namespace evalcache {
+
+	void Table::resize(int size) {
+		if (size == sizeMB && (entries != nullptr || size == 0)) return;
+		delete[] entries;
+		entries = nullptr;
+		mask = 0;
+		sizeMB = size;
+		if (size <= 0) return;
+		//Use the largest power of 2 number of entries fitting into the requested size
+		uint64_t count = 1;
+		while (2 * count * sizeof(uint64_t) <= (uint64_t(size) << 20)) count *= 2;
+		entries = new uint64_t[count];
+		mask = count - 1;
+		clear();
+	}
+
+	void Table::clear() {
+		if (entries) std::memset(entries, 0, (mask + 1) * sizeof(uint64_t));
+		ResetCounter();
+	}
+
+}
+
 namespace tt {
 
 	int initializedSizeInMB = 0;
 
 	uint8_t _generation = 0;
-	uint64_t ProbeCounter = 0;
-	uint64_t HitCounter = 0;
-	uint64_t FillCounter = 0;
 
-	uint64_t GetProbeCounter() { return ProbeCounter; }
-	uint64_t GetHitCounter() { return HitCounter; }
-	uint64_t GetFillCounter() { return FillCounter; }
+	Statistics ThreadStatistics[MAX_THREADS];
+	thread_local Statistics * threadStatistics = &ThreadStatistics[0];
+
+	Statistics & Statistics::operator+=(const Statistics & other) {
+		probes += other.probes;
+		hits += other.hits;
+		fills += other.fills;
+		replacementsAge += other.replacementsAge;
+		replacementsDepth += other.replacementsDepth;
+		invalidMoves += other.invalidMoves;
+		return *this;
+	}
 
-	Cluster * Table = nullptr;
-	uint64_t MASK;
+	Statistics GetStatistics() {
+		Statistics result;
+		for (int i = 0; i < MAX_THREADS; ++i) result += ThreadStatistics[i];
+		return result;
+	}
 
-	uint64_t GetHashFull() {
-		if (settings::parameter.HelperThreads == 0)
-			return 1000 * FillCounter / GetEntryCount();
-		else {
-			uint64_t result = 0;
-			for (int i = 0; i < 250; ++i) {
-				for (int j = 0; j < CLUSTER_SIZE; ++j) {
-					if (Table[i].entry[j].key) ++result;
-				}
+	void ResetCounter() {
+		for (int i = 0; i < MAX_THREADS; ++i) ThreadStatistics[i] = Statistics();
+	}
 
-			}
-			return result;
+	void printStatistics(std::ostream & stream) {
+		Statistics total = GetStatistics();
+		stream << std::left << std::setw(8) << "Thread" << std::setw(14) << "Probes" << std::setw(14) << "Hits" << std::setw(8) << "Hit[%]" << std::setw(14) << "Fills"
+			<< std::setw(14) << "Repl(Age)" << std::setw(14) << "Repl(Depth)" << std::setw(14) << "InvalidMoves" << std::endl;
+		for (int i = 0; i <= MAX_THREADS; ++i) {
+			const Statistics & stats = i < MAX_THREADS ? ThreadStatistics[i] : total;
+			if (i < MAX_THREADS && stats.probes == 0) continue;
+			stream << std::left << std::setw(8) << (i < MAX_THREADS ? std::to_string(i) : "Total") << std::setw(14) << stats.probes << std::setw(14) << stats.hits
+				<< std::setw(8) << std::fixed << std::setprecision(2) << (stats.probes ? 100.0 * stats.hits / stats.probes : 0.0) << std::setw(14) << stats.fills
+				<< std::setw(14) << stats.replacementsAge << std::setw(14) << stats.replacementsDepth << std::setw(14) << stats.invalidMoves << std::endl;
 		}
+		stream << "Hashfull: " << GetHashFull() << " permill of " << GetEntryCount() << " entries" << std::endl;
+	}
+
+	uint64_t GetProbeCounter() { return GetStatistics().probes; }
+	uint64_t GetHitCounter() { return GetStatistics().hits; }
+	uint64_t GetFillCounter() { return GetStatistics().fills; }
+
+	Cluster * Table = nullptr;
+	uint64_t ClusterCount;
+
+	uint64_t GetHashFull() {
+		return std::min(uint64_t(1000), 1000 * GetFillCounter() / GetEntryCount());
 	}
 
 	//Calculates the number of clusters in the transposition table if the table size should use
-	//sizeMB Megabytes (which is treated as upper limit)
+	//sizeMB Megabytes (which is treated as upper limit). The cluster count doesn't need to be a power of 2,
+	//as clusters are indexed by mapping the hash key onto [0, ClusterCount) (see firstEntry)
 	uint64_t CalculateClusterCount(int SizeMB) {
 		uint64_t clusterCount = SizeMB * 1024ull * 1024 / sizeof(Cluster);
-		clusterCount = 1ull << msb(clusterCount);
 		if (clusterCount < 1024) clusterCount = 1024;
 		return clusterCount;
 	}
 
-	void InitializeTranspositionTable() {
+	//On Linux the table is backed by huge pages whenever possible, as with large tables nearly every probe
+	//would otherwise cause a TLB miss. First choice are explicitly reserved huge pages (MAP_HUGETLB), if none are
+	//available transparent huge pages are requested via madvise. Other platforms use the default allocator.
+	enum AllocationMode { ALLOC_NONE, ALLOC_HUGETLB_1GB, ALLOC_HUGETLB_2MB, ALLOC_MADVISE, ALLOC_DEFAULT };
+	const char * AllocationModeNames[] = { "none", "huge pages (1GB)", "huge pages (2MB)", "transparent huge pages", "default pages" };
+	AllocationMode allocationMode = ALLOC_NONE;
+	size_t allocatedBytes = 0;
+	bool interleaved = false;
+
+	const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+	Cluster * allocatePages(size_t size) {
+#ifdef __linux__
+		size_t alignedSize = ((size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE) * HUGE_PAGE_SIZE;
+		void * mem = MAP_FAILED;
+#ifdef MAP_HUGE_1GB
+		const size_t GIGA_PAGE_SIZE = 1024 * 1024 * 1024;
+		if (size >= GIGA_PAGE_SIZE && size % GIGA_PAGE_SIZE == 0) {
+			mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_1GB, -1, 0);
+			if (mem != MAP_FAILED) {
+				allocationMode = ALLOC_HUGETLB_1GB;
+				allocatedBytes = size;
+				return static_cast<Cluster *>(mem);
+			}
+		}
+#endif
+		mem = mmap(nullptr, alignedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (mem != MAP_FAILED) {
+			allocationMode = ALLOC_HUGETLB_2MB;
+			allocatedBytes = alignedSize;
+			return static_cast<Cluster *>(mem);
+		}
+		mem = nullptr;
+		if (posix_memalign(&mem, HUGE_PAGE_SIZE, alignedSize) == 0) {
+#ifdef MADV_HUGEPAGE
+			allocationMode = madvise(mem, alignedSize, MADV_HUGEPAGE) == 0 ? ALLOC_MADVISE : ALLOC_DEFAULT;
+#else
+			allocationMode = ALLOC_DEFAULT;
+#endif
+			allocatedBytes = alignedSize;
+			return static_cast<Cluster *>(mem);
+		}
+#endif
+		allocationMode = ALLOC_DEFAULT;
+		allocatedBytes = size;
+		return static_cast<Cluster *>(malloc(size));
+	}
+
+	//In NUMA mode the pages are interleaved over all nodes, as all threads are accessing the whole table.
+	//This has to be done before the pages are touched for the first time
+	Cluster * allocate(size_t size) {
+		Cluster * mem = allocatePages(size);
+		interleaved = mem != nullptr && numa::interleave(mem, allocatedBytes);
+		return mem;
+	}
+
+	//Zeroes the table using one thread per search thread. Each thread touches the slice of the table
+	//it will be bound to, so that on NUMA systems the pages are placed near the threads using them.
+	//Returns the number of threads used
+	int zero() {
+		int threadCount = settings::parameter.HelperThreads + 1;
+		uint64_t clusterCount = GetClusterCount();
+		if (threadCount == 1 || clusterCount < 1024ull * threadCount) {
+			std::memset(Table, 0, clusterCount * sizeof(Cluster));
+			return 1;
+		}
+		std::vector<std::thread> threads;
+		for (int i = 0; i < threadCount; ++i) {
+			threads.push_back(std::thread([i, threadCount, clusterCount]() {
+				WinProcGroup::bindThisThread(i);
+				uint64_t start = clusterCount * i / threadCount;
+				uint64_t end = clusterCount * (i + 1) / threadCount;
+				std::memset(&Table[start], 0, (end - start) * sizeof(Cluster));
+			}));
+		}
+		for (auto & thread : threads) thread.join();
+		return threadCount;
+	}
+
+	void InitializeTranspositionTable(bool force) {
 		int newHashSize = settings::options.getInt(settings::OPTION_HASH);
-		if (initializedSizeInMB != newHashSize) {
+		if (initializedSizeInMB != newHashSize || force) {
+			int64_t begin = now();
 			FreeTranspositionTable();
 			uint64_t clusterCount = CalculateClusterCount(newHashSize);
-			Table = static_cast<Cluster *>(calloc(clusterCount, sizeof(Cluster)));
-			MASK = clusterCount - 1;
+			Table = allocate(clusterCount * sizeof(Cluster));
+			ClusterCount = clusterCount;
+			int threadCount = zero();
 			ResetCounter();
 			initializedSizeInMB = newHashSize;
+			std::stringstream ss;
+			ss << "Hash: " << (clusterCount * sizeof(Cluster) >> 20) << " MB allocated using " << AllocationModeNames[allocationMode];
+			if (interleaved) ss << " interleaved over " << numa::nodeCount() << " NUMA nodes";
+			ss << " and cleared by " << threadCount << " thread(s) in " << now() - begin << " ms";
+			utils::debugInfo(ss.str());
 		}
 	}
 
 	void clear() {
-		std::memset(Table, 0, (MASK + 1) * sizeof(Cluster));
+		int64_t begin = now();
+		int threadCount = zero();
+		//The table is empty again, so the fill counters (used for hashfull) have to restart. All other statistics are kept
+		for (int i = 0; i < MAX_THREADS; ++i) ThreadStatistics[i].fills = 0;
+		std::stringstream ss;
+		ss << "Hash cleared by " << threadCount << " thread(s) in " << now() - begin << " ms";
+		utils::debugInfo(ss.str());
 	}
 
 	void FreeTranspositionTable() {
 		if (Table != nullptr) {
-			delete[](Table);
+#ifdef __linux__
+			if (allocationMode == ALLOC_HUGETLB_1GB || allocationMode == ALLOC_HUGETLB_2MB) munmap(Table, allocatedBytes);
+			else free(Table);
+#else
+			free(Table);
+#endif
 			Table = nullptr;
+			allocationMode = ALLOC_NONE;
+			allocatedBytes = 0;
 		}
 	}
 
@@ -184,23 +357,27 @@ namespace tt {
 
 	}
 
-	uint64_t NMASK;
+	//The cluster index is the upper half of the 128 bit product hash * ClusterCount, which maps the hash key
+	//uniformly onto all clusters without needing a power of 2 table size
+	inline uint64_t clusterIndex(const uint64_t hash) {
+		return mul_hi64(hash, ClusterCount);
+	}
 
 	Entry* firstEntry(const uint64_t hash) {
-		return &Table[hash & MASK].entry[0];
+		return &Table[clusterIndex(hash)].entry[0];
 	}
 
 	void prefetch(uint64_t hash) {
 #ifdef _MSC_VER
-		_mm_prefetch((char*)&Table[hash & MASK], _MM_HINT_T0);
+		_mm_prefetch((char*)&Table[clusterIndex(hash)], _MM_HINT_T0);
 #endif // _MSC_VER
 #ifdef __GNUC__
-		__builtin_prefetch((char*)&Table[hash & MASK]);
+		__builtin_prefetch((char*)&Table[clusterIndex(hash)]);
 #endif // __GNUC__
 	}
 
 	uint64_t GetClusterCount() {
-		return MASK + 1;
+		return ClusterCount;
 	}
 	uint64_t GetEntryCount() {
 		return GetClusterCount() * CLUSTER_SIZE;
@@ -208,7 +385,7 @@ namespace tt {
 
 
 	bool dumpTT(std::ostream &stream) {
-		for (int i = 0; i <= MASK; ++i) {
+		for (uint64_t i = 0; i < ClusterCount; ++i) {
 			Cluster * cluster = &Table[i];
 			for (int j = 0; j < CLUSTER_SIZE; ++j) {
 				if (cluster->entry[j].generation() == _generation) {
@@ -218,6 +395,110 @@ namespace tt {
 }
 		return true;
 	}
+
+	//A snapshot file consists of a header followed by the raw cluster array. Snapshots can only be loaded by engines
+	//using the same snapshot format and entry layout, the cluster count is taken from the snapshot
+	const char SNAPSHOT_MAGIC[8] = { 'N', 'E', 'M', 'O', 'T', 'T', 0, 0 };
+	const uint32_t SNAPSHOT_VERSION = 1;
+
+	struct SnapshotHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t clusterSize;
+		uint64_t clusterCount;
+		uint8_t entriesPerCluster;
+		uint8_t generation;
+		uint8_t lockless; //1 if keys are stored using lockless hashing (THREAD_SAFE)
+		char build[45];
+	};
+
+	std::string buildInfo() {
+		std::stringstream ss;
+		ss << VERSION_INFO << "." << BUILD_NUMBER;
+		return ss.str();
+	}
+
+	bool saveSnapshot(const std::string & filename) {
+		std::ofstream file(filename, std::ios::binary | std::ios::out);
+		if (!file.is_open()) return false;
+		SnapshotHeader header;
+		std::memset(&header, 0, sizeof(SnapshotHeader));
+		std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+		header.version = SNAPSHOT_VERSION;
+		header.clusterSize = sizeof(Cluster);
+		header.clusterCount = ClusterCount;
+		header.entriesPerCluster = CLUSTER_SIZE;
+		header.generation = _generation;
+		header.lockless = settings::parameter.HelperThreads > 0;
+		std::strncpy(header.build, buildInfo().c_str(), sizeof(header.build) - 1);
+		file.write(reinterpret_cast<const char *>(&header), sizeof(SnapshotHeader));
+		file.write(reinterpret_cast<const char *>(Table), ClusterCount * sizeof(Cluster));
+		return file.good();
+	}
+
+	bool loadSnapshot(const std::string & filename, std::string & message) {
+		std::ifstream file(filename, std::ios::binary | std::ios::in);
+		if (!file.is_open()) {
+			message = "Can't open " + filename;
+			return false;
+		}
+		SnapshotHeader header;
+		file.read(reinterpret_cast<char *>(&header), sizeof(SnapshotHeader));
+		if (!file || std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) || header.version != SNAPSHOT_VERSION) {
+			message = filename + " is no valid hash snapshot";
+			return false;
+		}
+		if (header.clusterSize != sizeof(Cluster) || header.entriesPerCluster != CLUSTER_SIZE) {
+			message = filename + " uses a different entry layout";
+			return false;
+		}
+		if (header.clusterCount != ClusterCount) {
+			//Only table sizes, which can be set by the Hash option, are accepted
+			settings::OptionSpin * hashOption = static_cast<settings::OptionSpin *>(settings::options[settings::OPTION_HASH]);
+			if (header.clusterCount < CalculateClusterCount(hashOption->getMin()) || header.clusterCount > CalculateClusterCount(hashOption->getMax())
+				|| CalculateClusterCount(int(header.clusterCount * sizeof(Cluster) >> 20)) != header.clusterCount) {
+				message = filename + " has an invalid table size";
+				return false;
+			}
+			const int sizeMB = int(header.clusterCount * sizeof(Cluster) >> 20);
+			FreeTranspositionTable();
+			Table = allocate(header.clusterCount * sizeof(Cluster));
+			if (Table == nullptr) {
+				//Fall back to a table of the configured size
+				InitializeTranspositionTable(true);
+				message = "Not enough memory to load " + filename;
+				return false;
+			}
+			ClusterCount = header.clusterCount;
+			initializedSizeInMB = sizeMB;
+			hashOption->set(sizeMB);
+		}
+		file.read(reinterpret_cast<char *>(Table), ClusterCount * sizeof(Cluster));
+		if (!file) {
+			zero();
+			message = filename + " is truncated";
+			return false;
+		}
+		//Restore fill counter and convert keys, if snapshot has been created in a different threading mode
+		ResetCounter();
+		bool convert = (header.lockless != 0) != (settings::parameter.HelperThreads > 0);
+		for (uint64_t i = 0; i < ClusterCount; ++i) {
+			for (int j = 0; j < CLUSTER_SIZE; ++j) {
+				Entry & entry = Table[i].entry[j];
+				if (entry.empty()) continue;
+				++ThreadStatistics[0].fills;
+				if (convert) entry.key ^= fold(entry.data.dataAsInt);
+			}
+		}
+		_generation = header.generation;
+		std::string build(header.build, strnlen(header.build, sizeof(header.build)));
+		std::stringstream ss;
+		ss << "Hash snapshot " << filename << " loaded (" << (ClusterCount * sizeof(Cluster) >> 20) << " MB";
+		if (build != buildInfo()) ss << ", created by " << build;
+		ss << ")";
+		message = ss.str();
+		return true;
+	}
 }
 
 namespace killer {
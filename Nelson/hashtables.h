@@ -16,18 +16,81 @@ namespace pawn {
 		Eval Score;
 		uint8_t openFiles;
 		uint8_t halfOpenFiles[2];
+		//Pawn shelter and storm score per color and king file (filled lazily by evaluateKingSafety). shelterStormSquare contains the
+		//king square for which the value has been calculated (0xFF if not yet calculated)
+		uint8_t shelterStormSquare[2][8];
+		Eval shelterStorm[2][8];
 
 		inline int assymetry() { return popcount(halfOpenFiles[WHITE] ^ halfOpenFiles[BLACK]); }
 	};
 
-	extern Entry Table[PAWN_TABLE_SIZE];
+	//Pawn hash table. Every search thread owns its own table (see ThreadData), so there are no data races between threads
+	class Table {
+	public:
+		Table() { }
+		explicit Table(int sizeMB) { resize(sizeMB); }
+		~Table() { delete[] entries; }
+		//(Re-)allocates the table with sizeMB MB. Does nothing if size is unchanged
+		void resize(int sizeMB);
+		void clear();
+		//If there is no matching entry the entry is created and the pawn structure evaluation executed
+		Entry * probe(const Position &pos);
+	private:
+		Entry * entries = nullptr;
+		uint64_t mask = 0;
+		int sizeMB = 0;
+	};
+
+	//Table used by threads which haven't registered an own table
+	extern Table DefaultTable;
+	extern thread_local Table * threadTable;
+	//Makes the calling thread use table (nullptr: DefaultTable) for all subsequent probes
+	inline void registerTable(Table * table) { threadTable = table != nullptr ? table : &DefaultTable; }
 
 	void initialize();
 	void clear();
 
-	//If there is no matching entry the entry is created and the pawn structure evaluation executed
-	Entry * probe(const Position &pos);
+	inline Entry * probe(const Position &pos) { return threadTable->probe(pos); }
+
+}
+
+namespace evalcache {
+	//Small per-thread cache of static evaluations, consulted before Position::evaluate(). As every search thread
+	//owns its own table there is no need for locking. Each entry packs the upper 48 bits of the hash key and the
+	//16 bit evaluation into one 64 bit word
+	class Table {
+	public:
+		Table() { }
+		~Table() { delete[] entries; }
+		//(Re-)allocates the table with sizeMB MB (0 disables the cache). Does nothing if size is unchanged
+		void resize(int sizeMB);
+		void clear();
+
+		inline bool probe(uint64_t hash, Value & value) {
+			if (!entries) return false;
+			++probes;
+			uint64_t e = entries[hash & mask];
+			if (e == 0 || ((e ^ hash) & KEY_MASK) != 0) return false;
+			++hits;
+			value = Value(int16_t(e & ~KEY_MASK));
+			return true;
+		}
+
+		inline void store(uint64_t hash, Value value) {
+			if (entries) entries[hash & mask] = (hash & KEY_MASK) | uint16_t(int16_t(value));
+		}
 
+		inline uint64_t GetProbeCounter() const { return probes; }
+		inline uint64_t GetHitCounter() const { return hits; }
+		inline void ResetCounter() { probes = hits = 0; }
+	private:
+		static const uint64_t KEY_MASK = 0xFFFFFFFFFFFF0000ull;
+		uint64_t * entries = nullptr;
+		uint64_t mask = 0;
+		int sizeMB = 0;
+		uint64_t probes = 0;
+		uint64_t hits = 0;
+	};
 }
 
 namespace tt {
@@ -36,22 +99,56 @@ namespace tt {
 	//In single-thread mode, this isn't done
 	enum ProbeType { UNSAFE, THREAD_SAFE };
 
+	//Two entry layouts are available. By default an entry stores the full 64 bit hash key, which results in 4 entries
+	//per cluster (= cache line). If TT_COMPACT is defined, only a 16 bit fragment of the hash key is stored, so that
+	//6 entries fit into a cluster. As the cluster index is taken from the upper bits of the hash key (see clusterIndex)
+	//the fragment is taken from the lower bits
+#ifdef TT_COMPACT
+	const int CLUSTER_SIZE = 6;
+	typedef uint16_t KeyFragment_t;
+	inline KeyFragment_t keyFragment(uint64_t hash) { return KeyFragment_t(hash); }
+	//folds the entry data to the size of the key fragment (needed for lockless hashing)
+	inline KeyFragment_t fold(uint64_t data) { return KeyFragment_t(data ^ (data >> 16) ^ (data >> 32) ^ (data >> 48)); }
+#else
 	const int CLUSTER_SIZE = 4;
+	typedef uint64_t KeyFragment_t;
+	inline KeyFragment_t keyFragment(uint64_t hash) { return hash; }
+	inline KeyFragment_t fold(uint64_t data) { return data; }
+#endif
 
 	extern uint8_t _generation;
 	inline void newSearch() { _generation += 4; }
 
-	extern uint64_t ProbeCounter;
-	extern uint64_t HitCounter;
-	extern uint64_t FillCounter;
-	extern uint64_t MASK;
+	extern uint64_t ClusterCount;
+
+	//Usage statistics are collected per thread (each thread has it's own cache line) and are aggregated on demand
+	struct alignas(64) Statistics {
+		uint64_t probes = 0;
+		uint64_t hits = 0;
+		uint64_t fills = 0;             //entries written into empty slots
+		uint64_t replacementsAge = 0;   //entries from a previous search, which got replaced
+		uint64_t replacementsDepth = 0; //entries from the current search, which got replaced
+		uint64_t invalidMoves = 0;      //hash moves of hits, which aren't pseudo-legal in the probed position (key collisions or torn entries)
+
+		Statistics & operator+=(const Statistics & other);
+	};
+
+	extern Statistics ThreadStatistics[MAX_THREADS];
+	//Statistics of the current thread (threads which aren't registered use the statistics of thread 0)
+	extern thread_local Statistics * threadStatistics;
+	//Has to be called by each search thread before searching
+	inline void registerThread(int id) { threadStatistics = &ThreadStatistics[id]; }
+	//Has to be called, when the hash move of a hit turns out to be no valid move in the probed position
+	inline void countInvalidMove() { ++threadStatistics->invalidMoves; }
+	Statistics GetStatistics();
+	void printStatistics(std::ostream & stream);
 
 	uint64_t GetProbeCounter();
 	uint64_t GetHitCounter();
 	uint64_t GetFillCounter();
 	uint64_t GetHashFull();
 
-	inline void ResetCounter() { ProbeCounter = HitCounter = FillCounter = 0; }
+	void ResetCounter();
 	void clear();
 
 	//data stored in the transpodition table
@@ -68,8 +165,11 @@ namespace tt {
 		uint64_t dataAsInt;
 	};
 
+#ifdef TT_COMPACT
+#pragma pack(push, 2)
+#endif
 	struct Entry {
-		uint64_t key;
+		KeyFragment_t key;
 		DataUnion data;
 
 		NodeType type() const { return (NodeType)(data.details.gentype & 0x03); }
@@ -78,33 +178,52 @@ namespace tt {
 		Move move() { return data.details.move;  }
 		Value evalValue() { return data.details.evalValue; }
 		int8_t depth() { return data.details.depth; }
-		uint64_t GetKey() { return key ^ data.dataAsInt; }
+		KeyFragment_t GetKey() const { return key ^ fold(data.dataAsInt); }
+		//Updates the generation (keeping the key valid for lockless hashing)
+		template <ProbeType PT> inline void refresh() {
+			uint64_t oldData = data.dataAsInt;
+			data.details.gentype = uint8_t(_generation | type());
+			if (PT == THREAD_SAFE) key ^= fold(oldData) ^ fold(data.dataAsInt);
+		}
+#ifdef TT_COMPACT
+		bool empty() const { return key == 0 && data.dataAsInt == 0; }
+#else
+		bool empty() const { return key == 0; }
+#endif
+		template <ProbeType PT> inline bool matches(uint64_t hash) const { return (PT == THREAD_SAFE ? GetKey() : key) == keyFragment(hash); }
 
 		//Stores a changed 
 		template <ProbeType PT> inline void update(uint64_t hash, Value v, NodeType nt, int d, Move m, Value ev) {
-			if (PT == THREAD_SAFE) {
-				if (m || hash != GetKey()) // Preserve any existing move for the same position
-					data.details.move = m;
-			}
-			else {
-				FillCounter += (key == 0); //Initial entry get's overwritten
-				if (m || hash != key) // Preserve any existing move for the same position
-					data.details.move = m;
+			bool samePosition = matches<PT>(hash);
+			if (empty()) ++threadStatistics->fills; //Initial entry get's overwritten
+			else if (!samePosition) {
+				if (generation() == _generation) ++threadStatistics->replacementsDepth; else ++threadStatistics->replacementsAge;
 			}
+			if (m || !samePosition) // Preserve any existing move for the same position
+				data.details.move = m;
 			data.details.value = v;
 			data.details.evalValue = ev;
 			data.details.gentype = (uint8_t)(_generation | nt);
 			data.details.depth = (int8_t)d;
-			key = PT == THREAD_SAFE ? hash ^ data.dataAsInt : hash;
+			key = PT == THREAD_SAFE ? keyFragment(hash) ^ fold(data.dataAsInt) : keyFragment(hash);
 		}
 
 	};
 
 	struct Cluster {
 		Entry entry[CLUSTER_SIZE];
+#ifdef TT_COMPACT
+		char padding[4];
+#endif
 	};
+#ifdef TT_COMPACT
+#pragma pack(pop)
+#endif
 
-	void InitializeTranspositionTable();
+	static_assert(sizeof(Cluster) == 64, "Cluster size doesn't match cache line size");
+
+	//(Re-)allocates the table if the size has changed (or if force is true)
+	void InitializeTranspositionTable(bool force = false);
 
 	void FreeTranspositionTable();
 
@@ -114,12 +233,12 @@ namespace tt {
 		Entry* const tte = firstEntry(hash);
 		if (PT == THREAD_SAFE) {
 			for (unsigned i = 0; i < CLUSTER_SIZE; ++i) {
-				if (tte[i].GetKey() == hash) return tte[i].move();
+				if (tte[i].matches<THREAD_SAFE>(hash)) return tte[i].move();
 			}
 		}
 		else {
 			for (unsigned i = 0; i < CLUSTER_SIZE; ++i) {
-				if (tte[i].key == hash) return tte[i].move();
+				if (tte[i].matches<UNSAFE>(hash)) return tte[i].move();
 			}
 		}
 		return MOVE_NONE;
@@ -129,59 +248,103 @@ namespace tt {
 		Entry* const tte = firstEntry(hash);
 		if (PT == THREAD_SAFE) {
 			for (unsigned i = 0; i < CLUSTER_SIZE; ++i) {
-				if (tte[i].GetKey() == hash) return tte[i].evalValue();
+				if (tte[i].matches<THREAD_SAFE>(hash)) return tte[i].evalValue();
 			}
 		}
 		else {
 			for (unsigned i = 0; i < CLUSTER_SIZE; ++i) {
-				if (tte[i].key == hash) return tte[i].evalValue();
+				if (tte[i].matches<UNSAFE>(hash)) return tte[i].evalValue();
 			}
 		}
 		return VALUE_NOTYETDETERMINED;
 	}
 
+	//Replacement policies: Each policy selects the entry of a full cluster, which shall be replaced by a new position
+	//Strategy from an older version of Stockfish: prefer entries from older searches (unless EXACT), then lower depth
+	struct Legacy {
+		static const char * name() { return "Legacy"; }
+		static inline Entry* victim(Entry* tte) {
+			Entry* replace = tte;
+			for (unsigned i = 1; i < CLUSTER_SIZE; ++i)
+				if ((tte[i].generation() == _generation || tte[i].type() == EXACT)
+					- (replace->generation() == _generation)
+					- (tte[i].depth() < replace->depth()) < 0)
+					replace = &tte[i];
+			return replace;
+		}
+	};
+
+	//Replace the entry with the lowest depth, if depths are equal the older one
+	struct DepthPreferred {
+		static const char * name() { return "DepthPreferred"; }
+		static inline Entry* victim(Entry* tte) {
+			Entry* replace = tte;
+			for (unsigned i = 1; i < CLUSTER_SIZE; ++i)
+				if (tte[i].depth() < replace->depth()
+					|| (tte[i].depth() == replace->depth() && uint8_t(_generation - tte[i].generation()) > uint8_t(_generation - replace->generation())))
+					replace = &tte[i];
+			return replace;
+		}
+	};
+
+	//Replace the entry with the lowest depth, where each search since creation of the entry reduces the depth by 8
+	struct AgeWeighted {
+		static const char * name() { return "AgeWeighted"; }
+		static inline int worth(Entry* e) { return e->depth() - 2 * uint8_t(_generation - e->generation()); }
+		static inline Entry* victim(Entry* tte) {
+			Entry* replace = tte;
+			for (unsigned i = 1; i < CLUSTER_SIZE; ++i)
+				if (worth(&tte[i]) < worth(replace)) replace = &tte[i];
+			return replace;
+		}
+	};
+
+	//The last entry of each cluster is always replaced, unless there is an entry from an older search in the
+	//other (depth-preferred) entries
+	struct TwoTier {
+		static const char * name() { return "TwoTier"; }
+		static inline Entry* victim(Entry* tte) {
+			Entry* replace = tte;
+			for (unsigned i = 1; i < CLUSTER_SIZE - 1; ++i)
+				if (tte[i].generation() != _generation && (replace->generation() == _generation || tte[i].depth() < replace->depth()))
+					replace = &tte[i];
+			return replace->generation() != _generation ? replace : &tte[CLUSTER_SIZE - 1];
+		}
+	};
+
+#ifndef TT_REPLACEMENT_POLICY
+#define TT_REPLACEMENT_POLICY Legacy
+#endif
+	//Policy used by the engine (selected at compile time by defining TT_REPLACEMENT_POLICY)
+	typedef TT_REPLACEMENT_POLICY ReplacementPolicy;
+
 	template <ProbeType PT> inline Entry* probe(const uint64_t hash, bool& found, Entry& entry) {
 		Entry* const tte = firstEntry(hash);
-		if (PT == THREAD_SAFE) {
-			for (unsigned i = 0; i < CLUSTER_SIZE; ++i) {
-				if (!tte[i].key || tte[i].GetKey() == hash)
-				{
-					if (tte[i].key) {
-						tte[i].data.details.gentype = uint8_t(_generation | tte[i].type()); // Refresh
-					}
-					found = tte[i].key != 0;
-					entry = tte[i];
-					return &tte[i];
+		Statistics * stats = threadStatistics;
+		++stats->probes;
+		for (unsigned i = 0; i < CLUSTER_SIZE; ++i) {
+			if (tte[i].empty() || tte[i].matches<PT>(hash))
+			{
+				found = !tte[i].empty();
+				if (found) {
+					tte[i].refresh<PT>();
+					++stats->hits;
 				}
+				entry = tte[i];
+				return &tte[i];
 			}
 		}
-		else {
-			ProbeCounter++;
-			for (unsigned i = 0; i < CLUSTER_SIZE; ++i) {
-				if (!tte[i].key || tte[i].key == hash)
-				{
-					if (tte[i].key) {
-						tte[i].data.details.gentype = uint8_t(_generation | tte[i].type()); // Refresh
-						HitCounter++;
-					}
-					found = tte[i].key != 0;
-					entry = tte[i];
-					return &tte[i];
-				}
-			}
-		}
-		// Find an entry to be replaced according to the replacement strategy (which is from an older version of Stockfish)
-		Entry* replace = tte;
-		for (unsigned i = 1; i < CLUSTER_SIZE; ++i)
-			if ((tte[i].generation() == _generation || tte[i].type() == EXACT)
-				- (replace->generation() == _generation)
-				- (tte[i].depth() < replace->depth()) < 0)
-				replace = &tte[i];
-		return found = false, replace;
+		found = false;
+		return ReplacementPolicy::victim(tte);
 	}
 
 	bool dumpTT(std::ostream &stream);
 
+	//Writes the complete table into a versioned snapshot file
+	bool saveSnapshot(const std::string & filename);
+	//Restores the table (incl. size and generation) from a snapshot file. message contains the result as readable text
+	bool loadSnapshot(const std::string & filename, std::string & message);
+
 	void prefetch(uint64_t hash);
 
 	inline Value toTT(Value v, int pliesFromRoot) {
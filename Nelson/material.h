@@ -8,6 +8,7 @@ const int MATERIAL_KEY_OFFSET = 1839; //this assures that the Material Key is al
 const int MATERIAL_KEY_KvK = MATERIAL_KEY_OFFSET;
 const int MATERIAL_KEY_MAX = 729 + 1458 + 2 * (486 + 279 + 246) + 8 * (2916 + 26244) + MATERIAL_KEY_OFFSET;
 const int MATERIAL_KEY_UNUSUAL = MATERIAL_KEY_MAX + 1; //Entry for unusual Material distribution (like 3 Queens, 5 Bishops, ...)
+const int UNUSUAL_MATERIAL_TABLE_SIZE = 1 << 10; //has to be power of 2
 
 enum MaterialSearchFlags : uint8_t {
 	MSF_DEFAULT = 0,
@@ -28,6 +29,11 @@ struct MaterialTableEntry {
 	uint8_t Flags;
 	uint8_t MostValuedPiece; //high bits for black piece type
 
+	MaterialTableEntry() = default;
+	//Used by the material table generated at build time (constant initialization)
+	constexpr MaterialTableEntry(Eval evaluation, Phase_t phase, EvalFunction evaluationFunction, uint8_t flags, uint8_t mostValuedPiece)
+		: Evaluation(evaluation), Phase(phase), EvaluationFunction(evaluationFunction), Flags(flags), MostValuedPiece(mostValuedPiece) { }
+
 	inline bool IsLateEndgame() const { return EvaluationFunction != &evaluateDefault || Phase > 200; }
 	inline bool SkipPruning() const { return (Flags & MaterialSearchFlags::MSF_SKIP_PRUNING) != 0; }
 	inline bool IsTheoreticalDraw() const { return (Flags & MaterialSearchFlags::MSF_THEORETICAL_DRAW) != 0; }
@@ -46,7 +52,13 @@ struct MaterialTableEntry {
 };
 
 extern MaterialTableEntry MaterialTable[MATERIAL_KEY_MAX + 2];
-extern thread_local MaterialTableEntry UnusualMaterial;
+//Unusual material distributions can't be indexed by the material key. Their entries are therefore stored in a small per-thread hash table
+//keyed by Position::GetMaterialHash(). Entries might be overwritten, so that the key has to be checked at each use (see Position::GetMaterialTableEntry)
+struct UnusualMaterialEntry : MaterialTableEntry {
+	uint64_t Key = 0;
+};
+
+extern thread_local UnusualMaterialEntry UnusualMaterialTable[UNUSUAL_MATERIAL_TABLE_SIZE];
 
 //Phase is 0 in starting position and grows up to 256 when only kings are left
 inline Phase_t Phase(int nWQ, int nBQ, int nWR, int nBR, int nWB, int nBB, int nWN, int nBN) {
@@ -59,11 +71,18 @@ inline Phase_t Phase(int nWQ, int nBQ, int nWR, int nBR, int nWB, int nBB, int n
 
 const Phase_t PHASE_LIMIT_ENDGAME = Phase(0, 0, 1, 0, 0, 0, 1, 0);
 
+//Builds the material table from the current parameter values. At runtime this is only needed, when a material parameter is changed
 void InitializeMaterialTable();
+//Called at startup: If the material table has been generated at build time (MATERIAL_TABLE_EMBEDDED) with the current parameter values
+//nothing has to be done, otherwise the table is built
+void InitializeMaterialTableAtStartup();
+//Writes the material table as C++ source, which is embedded into the binary by the Makefile build
+bool WriteMaterialTable(const std::string & filename);
 
-inline MaterialTableEntry * probe(MaterialKey_t key) { if (key == MATERIAL_KEY_UNUSUAL) return &UnusualMaterial; else return &MaterialTable[key]; }
+inline MaterialTableEntry * probe(MaterialKey_t key) { return &MaterialTable[key]; }
 
-MaterialTableEntry * initUnusual(const Position &pos);
+//Returns the entry for a position with unusual material (entry is created if not yet in the table)
+MaterialTableEntry * probeUnusual(const Position &pos);
 
 Eval calculateMaterialEval(const Position &pos);
 
@@ -18,6 +18,13 @@
 
 static const std::string PieceToChar("QqRrBbNnPpKk ");
 
+thread_local MoveStack defaultMoveStack;
+thread_local MoveStack * threadMoveStack = nullptr;
+
+void registerMoveStack(MoveStack * stack) {
+	threadMoveStack = stack;
+}
+
 Position::Position()
 {
 	setFromFEN("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
@@ -29,10 +36,62 @@ Position::Position(std::string fen)
 }
 
 Position::Position(Position &pos) {
-	std::memcpy(this, &pos, offsetof(Position, previous));
+	copyBoard(pos);
 	material = pos.GetMaterialTableEntry();
-	pawn = pos.GetPawnEntry();
+	pawn = pos.pawn;
 	previous = &pos;
+	//the copy shares the move list with pos, it's only used after a move has been applied or after pos's search is done
+	bindMoveList();
+}
+
+Position & Position::operator=(const Position &pos) {
+	if (this == &pos) return *this;
+	copyBoard(pos);
+	previous = pos.previous;
+#ifdef MAKE_UNMAKE
+	undoCount = pos.undoCount;
+	undoTop = pos.undoTop;
+#endif
+	material = pos.material;
+	pawn = pos.pawn;
+	copy(pos);
+	dblAttacked[WHITE] = pos.dblAttacked[WHITE];
+	dblAttacked[BLACK] = pos.dblAttacked[BLACK];
+	result = pos.result;
+	capturedInLastMove = pos.capturedInLastMove;
+	bindMoveList();
+	if (moveList != pos.moveList) {
+		//only the generated moves are copied
+		static_cast<MoveIterator &>(*moveList) = *pos.moveList;
+		std::copy(pos.moveList->moves, pos.moveList->moves + pos.moveList->movepointer, moveList->moves);
+		if (moveList->processedMoveGenerationPhases & (1 << (int)QUIETS_POSITIVE))
+			moveList->firstNegative = moveList->moves + (pos.moveList->firstNegative - pos.moveList->moves);
+	}
+	return *this;
+}
+
+void Position::copyBoard(const Position &pos) {
+	std::copy(pos.OccupiedByColor, pos.OccupiedByColor + 2, OccupiedByColor);
+	std::copy(pos.OccupiedByPieceType, pos.OccupiedByPieceType + 6, OccupiedByPieceType);
+	Hash = pos.Hash;
+	MaterialKey = pos.MaterialKey;
+	PawnKey = pos.PawnKey;
+	EPSquare = pos.EPSquare;
+	CastlingOptions = pos.CastlingOptions;
+	DrawPlyCount = pos.DrawPlyCount;
+	SideToMove = pos.SideToMove;
+	pliesFromRoot = pos.pliesFromRoot;
+	historyIndex = pos.historyIndex;
+	pliesFromNull = pos.pliesFromNull;
+	std::copy(pos.Board, pos.Board + 64, Board);
+	PsqEval = pos.PsqEval;
+	kingSquares[WHITE] = pos.kingSquares[WHITE];
+	kingSquares[BLACK] = pos.kingSquares[BLACK];
+}
+
+void Position::bindMoveList() {
+	MoveStack * stack = threadMoveStack != nullptr ? threadMoveStack : &defaultMoveStack;
+	moveList = &stack->lists[pliesFromRoot & (MOVE_STACK_SIZE - 1)];
 }
 
 Position::~Position()
@@ -40,6 +99,8 @@ Position::~Position()
 }
 
 void Position::copy(const Position &pos) {
+	this->attacksOutdated = pos.attacksOutdated;
+	this->pinnedOutdated = pos.pinnedOutdated;
 	memcpy(this->attacks, pos.attacks, 64 * sizeof(Bitboard));
 	memcpy(this->attacksByPt, pos.attacksByPt, 12 * sizeof(Bitboard));
 	this->attackedByUs = pos.attackedByUs;
@@ -52,10 +113,11 @@ void Position::copy(const Position &pos) {
 	this->bbPinner[Color::BLACK] = pos.bbPinner[Color::BLACK];
 }
 
-int Position::AppliedMovesBeforeRoot = 0;
+thread_local uint64_t hashHistory[HASH_HISTORY_SIZE];
 
 bool Position::ApplyMove(Move move) {
 	pliesFromRoot++;
+	pliesFromNull++;
 	Square fromSquare = from(move);
 	Square toSquare = to(move);
 	Piece moving = Board[fromSquare];
@@ -92,14 +154,10 @@ bool Position::ApplyMove(Move move) {
 		//Adjust material key
 		if (capturedInLastMove != BLANK) {
 			if (MaterialKey == MATERIAL_KEY_UNUSUAL) {
-				if (checkMaterialIsUnusual()) {
-					material->Evaluation = calculateMaterialEval(*this);
-					material->SetIsTableBaseEntry(popcount(OccupiedByColor[WHITE] | OccupiedByColor[BLACK]) <= tablebases::MaxCardinality);
-				}
-				else MaterialKey = calculateMaterialKey();
+				if (!checkMaterialIsUnusual()) MaterialKey = calculateMaterialKey();
 			}
 			else MaterialKey -= materialKeyFactors[capturedInLastMove];
-			material = probe(MaterialKey);
+			InitMaterialPointer();
 		}
 		if (kingSquares[SideToMove] == fromSquare) kingSquares[SideToMove] = toSquare;
 		break;
@@ -107,13 +165,8 @@ bool Position::ApplyMove(Move move) {
 		set<true>(moving, toSquare);
 		remove(Square(toSquare - PawnStep()));
 		capturedInLastMove = Piece(BPAWN - SideToMove);
-		if (MaterialKey == MATERIAL_KEY_UNUSUAL) {
-			material->Evaluation = calculateMaterialEval(*this);
-		}
-		else {
-			MaterialKey -= materialKeyFactors[BPAWN - SideToMove];
-			material = probe(MaterialKey);
-		}
+		if (MaterialKey != MATERIAL_KEY_UNUSUAL) MaterialKey -= materialKeyFactors[BPAWN - SideToMove];
+		InitMaterialPointer();
 		SetEPSquare(OUTSIDE);
 		DrawPlyCount = 0;
 		PawnKey ^= ZobristKeys[moving][fromSquare];
@@ -130,7 +183,7 @@ bool Position::ApplyMove(Move move) {
 		//Adjust Material Key
 		if (checkMaterialIsUnusual()) {
 			MaterialKey = MATERIAL_KEY_UNUSUAL;
-			material = initUnusual(*this);
+			material = probeUnusual(*this);
 		}
 		else {
 			if (MaterialKey == MATERIAL_KEY_UNUSUAL) MaterialKey = calculateMaterialKey();
@@ -169,28 +222,167 @@ bool Position::ApplyMove(Move move) {
 	tt::prefetch(Hash); //for null move
 	SwitchSideToMove();
 	tt::prefetch(Hash);
-	movepointer = 0;
-	attackedByUs = calculateAttacks(SideToMove);
-	//calculatePinned();
-	attackedByThem = calculateAttacks(Color(SideToMove ^ 1));
+	hashHistory[++historyIndex & (HASH_HISTORY_SIZE - 1)] = Hash;
+	bindMoveList();
+	moveList->movepointer = 0;
+	//Attack maps are calculated, when they are needed the first time, legality is checked by looking for attackers of the king
+	attacksOutdated = true;
+	pinnedOutdated = true;
 	//assert((checkMaterialIsUnusual() && MaterialKey == MATERIAL_KEY_UNUSUAL) || MaterialKey == calculateMaterialKey());
 	//assert(PawnKey == calculatePawnKey());
-	CalculatePinnedPieces();
 	if (pawn->Key != PawnKey) pawn = pawn::probe(*this);
 	lastAppliedMove = move;
-	if (material->IsTheoreticalDraw()) result = Result::DRAW;
-	return !(attackedByUs & PieceBB(KING, Color(SideToMove ^ 1)));
+	if (GetMaterialTableEntry()->IsTheoreticalDraw()) result = Result::DRAW;
+	return !IsAttacked(kingSquares[SideToMove ^ 1], SideToMove);
 	//if (attackedByUs & PieceBB(KING, Color(SideToMove ^ 1))) return false;
 	//attackedByThem = calculateAttacks(Color(SideToMove ^1));
 	//return true;
 }
 
+#ifdef MAKE_UNMAKE
+thread_local UndoInfo undoStack[UNDO_STACK_SIZE];
+thread_local int undoStackPointer = 0;
+
+bool Position::DoMove(Move move) {
+	assert(undoStackPointer < UNDO_STACK_SIZE);
+	UndoInfo & undo = undoStack[undoStackPointer++];
+	undo.Hash = Hash;
+	undo.MaterialKey = MaterialKey;
+	undo.PawnKey = PawnKey;
+	undo.EPSquare = EPSquare;
+	undo.CastlingOptions = CastlingOptions;
+	undo.DrawPlyCount = DrawPlyCount;
+	undo.capturedInLastMove = capturedInLastMove;
+	undo.lastAppliedMove = lastAppliedMove;
+	undo.lastMovingPiece = lastAppliedMove != MOVE_NONE ? Board[to(FixCastlingMove(lastAppliedMove))] : BLANK;
+	undo.result = result;
+	undo.StaticEval = StaticEval;
+	undo.material = material;
+	undo.pawn = pawn;
+	undo.moveList = moveList;
+	//The successor uses the squares attacked by this position's side to move for move ordering (see evaluateByHistory). They are only
+	//saved, if they are known anyway, the attack maps aren't calculated for that purpose
+	undo.attackedByUsValid = !attacksOutdated;
+	undo.attackedByUs = attackedByUs;
+	++undoCount;
+	undoTop = undoStackPointer;
+	result = Result::RESULT_UNKNOWN;
+	StaticEval = VALUE_NOTYETDETERMINED;
+	return ApplyMove(move);
+}
+
+void Position::UndoMove(Move move) {
+	assert(undoCount > 0 && undoTop == undoStackPointer);
+	const UndoInfo & undo = undoStack[--undoStackPointer];
+	SideToMove = Color(SideToMove ^ 1);
+	const Square fromSquare = from(move);
+	const Square toSquare = to(move);
+	switch (type(move)) {
+	case NORMAL:
+		if (toSquare == kingSquares[SideToMove]) kingSquares[SideToMove] = fromSquare;
+		set<true>(Board[toSquare], fromSquare);
+		remove(toSquare);
+		if (capturedInLastMove != BLANK) set<true>(capturedInLastMove, toSquare);
+		break;
+	case ENPASSANT:
+		set<true>(Board[toSquare], fromSquare);
+		remove(toSquare);
+		set<true>(capturedInLastMove, Square(toSquare - PawnStep()));
+		break;
+	case PROMOTION:
+		remove(toSquare);
+		set<true>(GetPiece(PAWN, SideToMove), fromSquare);
+		if (capturedInLastMove != BLANK) set<true>(capturedInLastMove, toSquare);
+		break;
+	case CASTLING: {
+		//King and rook are removed first, as in Chess960 their squares might overlap
+		const bool shortCastling = kingSquares[SideToMove] == G1 + (SideToMove * 56);
+		const Square rookSquare = Square(kingSquares[SideToMove] + (shortCastling ? -1 : 1));
+		remove(kingSquares[SideToMove]);
+		remove(rookSquare);
+		set<true>(GetPiece(KING, SideToMove), fromSquare);
+		set<true>(GetPiece(ROOK, SideToMove), InitialRookSquare[2 * SideToMove + !shortCastling]);
+		kingSquares[SideToMove] = fromSquare;
+		break;
+	}
+	}
+	Hash = undo.Hash;
+	MaterialKey = undo.MaterialKey;
+	PawnKey = undo.PawnKey;
+	EPSquare = undo.EPSquare;
+	CastlingOptions = undo.CastlingOptions;
+	DrawPlyCount = undo.DrawPlyCount;
+	capturedInLastMove = undo.capturedInLastMove;
+	lastAppliedMove = undo.lastAppliedMove;
+	result = undo.result;
+	StaticEval = undo.StaticEval;
+	material = undo.material;
+	pawn = undo.pawn;
+	moveList = undo.moveList;
+	--pliesFromRoot;
+	--pliesFromNull;
+	--historyIndex;
+	attacksOutdated = true;
+	pinnedOutdated = true;
+	--undoCount;
+	undoTop = undoStackPointer;
+}
+#endif
+
+Piece Position::GetPreviousMovingPiece() const {
+	if (lastAppliedMove == MOVE_NONE) return BLANK;
+#ifdef MAKE_UNMAKE
+	//the piece on the target square has been captured (apart from en passant captures) or it's the rook of a Chess960 castling move
+	if (undoCount > 0) return type(lastAppliedMove) == ENPASSANT ? BLANK : capturedInLastMove;
+#endif
+	return previous ? previous->GetPieceOnSquare(to(lastAppliedMove)) : BLANK;
+}
+
+Move Position::GetPreviousLastAppliedMove() const {
+#ifdef MAKE_UNMAKE
+	if (undoCount > 0) return undoStack[undoTop - 1].lastAppliedMove;
+#endif
+	return previous ? previous->lastAppliedMove : MOVE_NONE;
+}
+
+Piece Position::GetPreviousLastMovingPiece() const {
+#ifdef MAKE_UNMAKE
+	if (undoCount > 0) return undoStack[undoTop - 1].lastMovingPiece;
+#endif
+	return previous->Board[to(FixCastlingMove(previous->lastAppliedMove))];
+}
+
+Bitboard Position::GetPreviousAttackedByUs() const {
+#ifdef MAKE_UNMAKE
+	//If the attack maps of the previous position haven't been calculated, no square is considered as newly attacked
+	if (undoCount > 0) return undoStack[undoTop - 1].attackedByUsValid ? undoStack[undoTop - 1].attackedByUs : AttackedByThem();
+#endif
+	return previous->AttackedByUs();
+}
+
+bool Position::GetAncestorStaticEval(int plies, Value & staticEval) const {
+#ifdef MAKE_UNMAKE
+	//The undo stack contains the positions up to undoCount plies before, the position before them is the previous position
+	if (plies <= undoCount) {
+		staticEval = undoStack[undoTop - plies].StaticEval;
+		return true;
+	}
+	plies -= undoCount;
+#endif
+	if (previous == nullptr) return false;
+	if (plies == 1) {
+		staticEval = previous->StaticEval;
+		return true;
+	}
+	return previous->GetAncestorStaticEval(plies - 1, staticEval);
+}
+
 void Position::AddUnderPromotions() {
-	if (canPromote) {
-		movepointer--;
-		int moveCount = movepointer;
+	if (moveList->canPromote) {
+		moveList->movepointer--;
+		int moveCount = moveList->movepointer;
 		for (int i = 0; i < moveCount; ++i) {
-			Move pmove = moves[i].move;
+			Move pmove = moveList->moves[i].move;
 			if (type(pmove) == PROMOTION) {
 				AddMove(createMove<PROMOTION>(from(pmove), to(pmove), KNIGHT));
 				AddMove(createMove<PROMOTION>(from(pmove), to(pmove), ROOK));
@@ -202,56 +394,56 @@ void Position::AddUnderPromotions() {
 }
 
 Move Position::NextMove() {
-	if (generationPhases[generationPhase] == NONE) return MOVE_NONE;
+	if (generationPhases[moveList->generationPhase] == NONE) return MOVE_NONE;
 	Move move;
 	do {
-		processedMoveGenerationPhases |= 1 << (int)generationPhases[generationPhase];
-		if (moveIterationPointer < 0) {
-			phaseStartIndex = movepointer - (movepointer != 0);
-			switch (generationPhases[generationPhase]) {
+		moveList->processedMoveGenerationPhases |= 1 << (int)generationPhases[moveList->generationPhase];
+		if (moveList->moveIterationPointer < 0) {
+			moveList->phaseStartIndex = moveList->movepointer - (moveList->movepointer != 0);
+			switch (generationPhases[moveList->generationPhase]) {
 			case KILLER:
-				moveIterationPointer = 0;
+				moveList->moveIterationPointer = 0;
 				break;
 			case NON_LOOSING_CAPTURES:
 				GenerateMoves<NON_LOOSING_CAPTURES>();
 				evaluateByCaptureScore();
-				moveIterationPointer = 0;
+				moveList->moveIterationPointer = 0;
 				break;
 			case LOOSING_CAPTURES:
 				GenerateMoves<LOOSING_CAPTURES>();
-				evaluateByCaptureScore(phaseStartIndex);
-				moveIterationPointer = 0;
+				evaluateByCaptureScore(moveList->phaseStartIndex);
+				moveList->moveIterationPointer = 0;
 				break;
 				//case QUIETS:
 				//	GenerateMoves<QUIETS>();
 				//	evaluateByHistory(phaseStartIndex);
-				//	shellSort(moves + phaseStartIndex, movepointer - phaseStartIndex - 1);
+				//	shellSort(moveList->moves + phaseStartIndex, movepointer - phaseStartIndex - 1);
 				//	moveIterationPointer = 0;
 				//	break;
 			case QUIETS_POSITIVE:
 				GenerateMoves<QUIETS>();
-				evaluateByHistory(phaseStartIndex);
-				firstNegative = std::partition(moves + phaseStartIndex, &moves[movepointer - 1], positiveScore);
-				insertionSort(moves + phaseStartIndex, firstNegative);
-				moveIterationPointer = 0;
+				evaluateByHistory(moveList->phaseStartIndex);
+				moveList->firstNegative = std::partition(moveList->moves + moveList->phaseStartIndex, &moveList->moves[moveList->movepointer - 1], positiveScore);
+				insertionSort(moveList->moves + moveList->phaseStartIndex, moveList->firstNegative);
+				moveList->moveIterationPointer = 0;
 				break;
 			case CHECK_EVASION:
 				GenerateMoves<CHECK_EVASION>();
-				evaluateCheckEvasions(phaseStartIndex);
-				moveIterationPointer = 0;
+				evaluateCheckEvasions(moveList->phaseStartIndex);
+				moveList->moveIterationPointer = 0;
 				break;
 			case QUIET_CHECKS:
 				GenerateMoves<QUIET_CHECKS>();
 				//evaluateBySEE(phaseStartIndex);
-				//insertionSort(moves + phaseStartIndex, moves + (movepointer - 1));
-				moveIterationPointer = 0;
+				//insertionSort(moveList->moves + phaseStartIndex, moveList->moves + (movepointer - 1));
+				moveList->moveIterationPointer = 0;
 				break;
 			case UNDERPROMOTION:
-				if (canPromote) {
-					movepointer--;
-					int moveCount = movepointer;
+				if (moveList->canPromote) {
+					moveList->movepointer--;
+					int moveCount = moveList->movepointer;
 					for (int i = 0; i < moveCount; ++i) {
-						Move pmove = moves[i].move;
+						Move pmove = moveList->moves[i].move;
 						if (type(pmove) == PROMOTION) {
 							AddMove(createMove<PROMOTION>(from(pmove), to(pmove), KNIGHT));
 							AddMove(createMove<PROMOTION>(from(pmove), to(pmove), ROOK));
@@ -259,68 +451,71 @@ Move Position::NextMove() {
 						}
 					}
 					AddNullMove();
-					phaseStartIndex = moveCount;
-					moveIterationPointer = 0;
+					moveList->phaseStartIndex = moveCount;
+					moveList->moveIterationPointer = 0;
 					break;
 				}
 				else return MOVE_NONE;
 			case FORKS:
 				GenerateForks(true);
-				moveIterationPointer = 0;
+				moveList->moveIterationPointer = 0;
 				break;
 			case FORKS_NO_CHECKS:
 				GenerateForks(false);
-				moveIterationPointer = 0;
+				moveList->moveIterationPointer = 0;
 				break;
 			case ALL:
 				GenerateMoves<ALL>();
-				moveIterationPointer = 0;
+				moveList->moveIterationPointer = 0;
 				break;
 			default:
 				break;
 			}
 
 		}
-		switch (generationPhases[generationPhase]) {
+		switch (generationPhases[moveList->generationPhase]) {
 		case HASHMOVE:
-			++generationPhase;
-			moveIterationPointer = -1;
-			if (validateMove(hashMove)) return hashMove;
+			++moveList->generationPhase;
+			moveList->moveIterationPointer = -1;
+			if (moveList->hashMove != MOVE_NONE) {
+				if (validateMove(moveList->hashMove)) return moveList->hashMove;
+				tt::countInvalidMove();
+			}
 			break;
 		case KILLER:
-			while (killerManager && moveIterationPointer < killer::NB_KILLER) {
-				Move killerMove = killerManager->getMove(*this, moveIterationPointer);
-				++moveIterationPointer;
+			while (moveList->killerManager && moveList->moveIterationPointer < killer::NB_KILLER) {
+				Move killerMove = moveList->killerManager->getMove(*this, moveList->moveIterationPointer);
+				++moveList->moveIterationPointer;
 				//if (killerMove != MOVE_NONE && validateMove(killerMove))  return killerMove;
-				if (killerMove != MOVE_NONE && killerMove != hashMove && validateMove(killerMove)) return killerMove;
+				if (killerMove != MOVE_NONE && killerMove != moveList->hashMove && validateMove(killerMove)) return killerMove;
 			}
-			++generationPhase;
-			moveIterationPointer = -1;
+			++moveList->generationPhase;
+			moveList->moveIterationPointer = -1;
 			break;
 		case NON_LOOSING_CAPTURES:
-			move = getBestMove(phaseStartIndex + moveIterationPointer);
+			move = getBestMove(moveList->phaseStartIndex + moveList->moveIterationPointer);
 			if (move) {
-				++moveIterationPointer;
+				++moveList->moveIterationPointer;
 				goto end_post_hash;
 			}
 			else {
-				++generationPhase;
-				moveIterationPointer = -1;
+				++moveList->generationPhase;
+				moveList->moveIterationPointer = -1;
 			}
 			break;
 		case LOOSING_CAPTURES: case QUIETS_NEGATIVE:
-			move = getBestMove(phaseStartIndex + moveIterationPointer);
+			move = getBestMove(moveList->phaseStartIndex + moveList->moveIterationPointer);
 			if (move) {
-				++moveIterationPointer;
+				++moveList->moveIterationPointer;
 				goto end_post_killer;
 			}
 			else {
-				++generationPhase;
-				moveIterationPointer = -1;
+				++moveList->generationPhase;
+				moveList->moveIterationPointer = -1;
 			}
 			break;
 			//case QUIETS:
-			//	move = moves[phaseStartIndex + moveIterationPointer].move;
+			//	move = moveList->moves[phaseStartIndex + moveIterationPointer].move;
 			//	if (move) {
 			//		++moveIterationPointer;
 			//		goto end_post_killer;
@@ -332,49 +527,49 @@ Move Position::NextMove() {
 			//	break;
 		case CHECK_EVASION: case QUIET_CHECKS: case FORKS: case FORKS_NO_CHECKS:
 #pragma warning(suppress: 6385)
-			move = moves[phaseStartIndex + moveIterationPointer].move;
+			move = moveList->moves[moveList->phaseStartIndex + moveList->moveIterationPointer].move;
 			if (move) {
-				++moveIterationPointer;
+				++moveList->moveIterationPointer;
 				goto end_post_hash;
 			}
 			else {
-				++generationPhase;
-				moveIterationPointer = -1;
+				++moveList->generationPhase;
+				moveList->moveIterationPointer = -1;
 			}
 			break;
 		case QUIETS_POSITIVE:
-			move = moves[phaseStartIndex + moveIterationPointer].move;
-			if (move == firstNegative->move) {
-				++generationPhase;
+			move = moveList->moves[moveList->phaseStartIndex + moveList->moveIterationPointer].move;
+			if (move == moveList->firstNegative->move) {
+				++moveList->generationPhase;
 			}
 			else {
-				++moveIterationPointer;
+				++moveList->moveIterationPointer;
 				goto end_post_killer;
 			}
 			break;
 		case REPEAT_ALL: case ALL:
 #pragma warning(suppress: 6385)
-			move = moves[moveIterationPointer].move;
-			++moveIterationPointer;
-			generationPhase += (moveIterationPointer >= movepointer);
+			move = moveList->moves[moveList->moveIterationPointer].move;
+			++moveList->moveIterationPointer;
+			moveList->generationPhase += (moveList->moveIterationPointer >= moveList->movepointer);
 			goto end;
 		case UNDERPROMOTION:
 #pragma warning(suppress: 6385)
-			move = moves[phaseStartIndex + moveIterationPointer].move;
-			++moveIterationPointer;
-			generationPhase += (phaseStartIndex + moveIterationPointer >= movepointer);
+			move = moveList->moves[moveList->phaseStartIndex + moveList->moveIterationPointer].move;
+			++moveList->moveIterationPointer;
+			moveList->generationPhase += (moveList->phaseStartIndex + moveList->moveIterationPointer >= moveList->movepointer);
 			goto end_post_hash;
 		default:
 			assert(true);
 		}
-	} while (generationPhases[generationPhase] != NONE);
+	} while (generationPhases[moveList->generationPhase] != NONE);
 	return MOVE_NONE;
 end_post_killer:
-	if (killerManager != nullptr && (processedMoveGenerationPhases & (1 << (int)MoveGenerationType::KILLER)) != 0) {
-		if (killerManager->isKiller(*this, move)) return NextMove();
+	if (moveList->killerManager != nullptr && (moveList->processedMoveGenerationPhases & (1 << (int)MoveGenerationType::KILLER)) != 0) {
+		if (moveList->killerManager->isKiller(*this, move)) return NextMove();
 	}
 end_post_hash:
-	if (hashMove && move == hashMove) return NextMove();
+	if (moveList->hashMove && move == moveList->hashMove) return NextMove();
 end:
 	return move;
 }
@@ -407,41 +602,41 @@ void Position::shellSort(ValuatedMove* vm, int count) {
 }
 
 void Position::evaluateByCaptureScore(int startIndex) {
-	for (int i = startIndex; i < movepointer - 1; ++i) {
-		moves[i].score = settings::parameter.CAPTURE_SCORES[GetPieceType(Board[from(moves[i].move)])][GetPieceType(Board[to(moves[i].move)])] + 2 * (type(moves[i].move) == PROMOTION);
+	for (int i = startIndex; i < moveList->movepointer - 1; ++i) {
+		moveList->moves[i].score = settings::parameter.CAPTURE_SCORES[GetPieceType(Board[from(moveList->moves[i].move)])][GetPieceType(Board[to(moveList->moves[i].move)])] + 2 * (type(moveList->moves[i].move) == PROMOTION);
 	}
 }
 
 void Position::evaluateByMVVLVA(int startIndex) {
-	for (int i = startIndex; i < movepointer - 1; ++i) {
-		moves[i].score = settings::parameter.PieceValues[GetPieceType(Board[to(moves[i].move)])].mgScore - 150 * relativeRank(GetSideToMove(), Rank(to(moves[i].move) >> 3));
+	for (int i = startIndex; i < moveList->movepointer - 1; ++i) {
+		moveList->moves[i].score = settings::parameter.PieceValues[GetPieceType(Board[to(moveList->moves[i].move)])].mgScore - 150 * relativeRank(GetSideToMove(), Rank(to(moveList->moves[i].move) >> 3));
 	}
 }
 
 void Position::evaluateBySEE(int startIndex) {
-	if (movepointer - 2 == startIndex)
-		moves[startIndex].score = settings::parameter.PieceValues[QUEEN].mgScore; //No need for SEE if there is only one move to be evaluated
+	if (moveList->movepointer - 2 == startIndex)
+		moveList->moves[startIndex].score = settings::parameter.PieceValues[QUEEN].mgScore; //No need for SEE if there is only one move to be evaluated
 	else
-		for (int i = startIndex; i < movepointer - 1; ++i) moves[i].score = SEE(moves[i].move);
+		for (int i = startIndex; i < moveList->movepointer - 1; ++i) moveList->moves[i].score = SEE(moveList->moves[i].move);
 }
 
 void Position::evaluateCheckEvasions(int startIndex) {
-	ValuatedMove * firstQuiet = std::partition(moves + startIndex, &moves[movepointer - 1], [this](ValuatedMove m) { return IsTactical(m); });
+	ValuatedMove * firstQuiet = std::partition(moveList->moves + startIndex, &moveList->moves[moveList->movepointer - 1], [this](ValuatedMove m) { return IsTactical(m); });
 	bool quiets = false;
 	int quietsIndex = startIndex;
-	for (int i = startIndex; i < movepointer - 1; ++i) {
-		quiets = quiets || (moves[i].move == firstQuiet->move);
-		if (quiets && history) {
-			Piece p = Board[from(moves[i].move)];
-			moves[i].score = history->getValue(p, moves[i].move);
+	for (int i = startIndex; i < moveList->movepointer - 1; ++i) {
+		quiets = quiets || (moveList->moves[i].move == firstQuiet->move);
+		if (quiets && moveList->history) {
+			Piece p = Board[from(moveList->moves[i].move)];
+			moveList->moves[i].score = moveList->history->getValue(p, moveList->moves[i].move);
 		}
 		else {
-			moves[i].score = settings::parameter.CAPTURE_SCORES[GetPieceType(Board[from(moves[i].move)])][GetPieceType(Board[to(moves[i].move)])] + 2 * (type(moves[i].move) == PROMOTION);
+			moveList->moves[i].score = settings::parameter.CAPTURE_SCORES[GetPieceType(Board[from(moveList->moves[i].move)])][GetPieceType(Board[to(moveList->moves[i].move)])] + 2 * (type(moveList->moves[i].move) == PROMOTION);
 			quietsIndex++;
 		}
 	}
-	if (quietsIndex > startIndex + 1) insertionSort(moves + startIndex, moves + quietsIndex - 1);
-	if (movepointer - 2 > quietsIndex) insertionSort(moves + quietsIndex, &moves[movepointer - 1]);
+	if (quietsIndex > startIndex + 1) insertionSort(moveList->moves + startIndex, moveList->moves + quietsIndex - 1);
+	if (moveList->movepointer - 2 > quietsIndex) insertionSort(moveList->moves + quietsIndex, &moveList->moves[moveList->movepointer - 1]);
 }
 
 Move Position::GetCounterMove(Move(&counterMoves)[12][64]) {
@@ -458,49 +653,50 @@ void Position::evaluateByHistory(int startIndex) {
 	if (lastAppliedMove != MOVE_NONE) {
 		lastMoves[0] = FixCastlingMove(lastAppliedMove);
 		lastMovingPieces[0] = Board[to(lastMoves[0])];
-		if (Previous() && Previous()->lastAppliedMove != MOVE_NONE) {
-			lastMoves[1] = FixCastlingMove(Previous()->lastAppliedMove);
-			lastMovingPieces[1] = Previous()->Board[to(lastMoves[1])];
+		Move previousMove = GetPreviousLastAppliedMove();
+		if (previousMove != MOVE_NONE) {
+			lastMoves[1] = FixCastlingMove(previousMove);
+			lastMovingPieces[1] = GetPreviousLastMovingPiece();
 		}
 	}
-	Bitboard bbNewlyAttacked = lastAppliedMove == MOVE_NONE ? EMPTY : (~(Previous()->attackedByUs)) & AttackedByThem();
-	for (int i = startIndex; i < movepointer - 1; ++i) {
-		if (moves[i].move == counterMove) {
-			moves[i].score = VALUE_MATE;
+	Bitboard bbNewlyAttacked = lastAppliedMove == MOVE_NONE ? EMPTY : (~GetPreviousAttackedByUs()) & AttackedByThem();
+	for (int i = startIndex; i < moveList->movepointer - 1; ++i) {
+		if (moveList->moves[i].move == moveList->counterMove) {
+			moveList->moves[i].score = VALUE_MATE;
 		}
 		else
-			if (history) {
-				Move fixedMove = FixCastlingMove(moves[i].move);
+			if (moveList->history) {
+				Move fixedMove = FixCastlingMove(moveList->moves[i].move);
 				Square toSquare = to(fixedMove);
 				Piece p = Board[from(fixedMove)];
-				moves[i].score = Value(history->getValue(p, fixedMove) - ChebishevDistance(toSquare, KingSquare(Color(SideToMove ^ 1)))); //History + king tropism if equal
-				if (lastMoves[0] && cmHistory) {
-					moves[i].score += 2 * cmHistory->getValue(lastMovingPieces[0], to(lastMoves[0]), p, toSquare);
-					if (lastMoves[1]) moves[i].score += 2 * followupHistory->getValue(lastMovingPieces[1], to(lastMoves[1]), p, toSquare);
+				moveList->moves[i].score = Value(moveList->history->getValue(p, fixedMove) - ChebishevDistance(toSquare, KingSquare(Color(SideToMove ^ 1)))); //History + king tropism if equal
+				if (lastMoves[0] && moveList->cmHistory) {
+					moveList->moves[i].score += 2 * moveList->cmHistory->getValue(lastMovingPieces[0], to(lastMoves[0]), p, toSquare);
+					if (lastMoves[1]) moveList->moves[i].score += 2 * moveList->followupHistory->getValue(lastMovingPieces[1], to(lastMoves[1]), p, toSquare);
 				}
 				Bitboard toBB = ToBitboard(toSquare);
-				if (ToBitboard(from(moves[i].move)) & bbNewlyAttacked) moves[i].score = Value(moves[i].score + 100);
+				if (ToBitboard(from(moveList->moves[i].move)) & bbNewlyAttacked) moveList->moves[i].score = Value(moveList->moves[i].score + 100);
 				if ((toBB & (attackedByUs | ~attackedByThem)) != EMPTY)
-					moves[i].score = Value(moves[i].score + 500);
+					moveList->moves[i].score = Value(moveList->moves[i].score + 500);
 				else if ((p < WPAWN) && (toBB & AttacksByPieceType(Color(SideToMove ^ 1), PAWN)) != 0) {
-					moves[i].score = Value(moves[i].score - 500);
+					moveList->moves[i].score = Value(moveList->moves[i].score - 500);
 				}
-				assert(moves[i].score < VALUE_MATE);
+				assert(moveList->moves[i].score < VALUE_MATE);
 			}
-			else moves[i].score = VALUE_DRAW;
+			else moveList->moves[i].score = VALUE_DRAW;
 	}
 }
 
 Move Position::getBestMove(int startIndex) {
-	ValuatedMove bestmove = moves[startIndex];
-	for (int i = startIndex + 1; i < movepointer - 1; ++i) {
-		if (bestmove < moves[i]) {
-			moves[startIndex] = moves[i];
-			moves[i] = bestmove;
-			bestmove = moves[startIndex];
+	ValuatedMove bestmove = moveList->moves[startIndex];
+	for (int i = startIndex + 1; i < moveList->movepointer - 1; ++i) {
+		if (bestmove < moveList->moves[i]) {
+			moveList->moves[startIndex] = moveList->moves[i];
+			moveList->moves[i] = bestmove;
+			bestmove = moveList->moves[startIndex];
 		}
 	}
-	return moves[startIndex].score > -VALUE_MATE ? moves[startIndex].move : MOVE_NONE;
+	return moveList->moves[startIndex].score > -VALUE_MATE ? moveList->moves[startIndex].move : MOVE_NONE;
 }
 
 template<bool SquareIsEmpty> void Position::set(const Piece piece, const Square square) {
@@ -548,69 +744,82 @@ void Position::updateCastleFlags(Square fromSquare, Square toSquare) {
 	}
 }
 
-Bitboard Position::calculateAttacks(Color color) {
+void Position::calculateAttackMaps() const {
+	if (SideToMove == WHITE) {
+		attackedByUs = calculateAttacks<WHITE>();
+		attackedByThem = calculateAttacks<BLACK>();
+	}
+	else {
+		attackedByUs = calculateAttacks<BLACK>();
+		attackedByThem = calculateAttacks<WHITE>();
+	}
+	CalculatePinnedPieces();
+	attacksOutdated = false;
+}
+
+template<Color COLOR> Bitboard Position::calculateAttacks() const {
 	Bitboard occupied = OccupiedBB();
-	attacksByPt[GetPiece(ROOK, color)] = 0ull;
-	Bitboard rookSliders = PieceBB(ROOK, color);
+	attacksByPt[GetPiece(ROOK, COLOR)] = 0ull;
+	Bitboard rookSliders = PieceBB(ROOK, COLOR);
 	Bitboard bbAttacks = EMPTY;
-	dblAttacked[color] = EMPTY;
+	dblAttacked[COLOR] = EMPTY;
 	while (rookSliders) {
 		Square sq = lsb(rookSliders);
 		Bitboard a = RookTargets(sq, occupied);
-		dblAttacked[color] |= bbAttacks & a;
+		dblAttacked[COLOR] |= bbAttacks & a;
 		attacks[sq] = a;
 		bbAttacks |= a;
-		attacksByPt[GetPiece(ROOK, color)] |= attacks[sq];
+		attacksByPt[GetPiece(ROOK, COLOR)] |= attacks[sq];
 		rookSliders &= rookSliders - 1;
 	}
-	attacksByPt[GetPiece(BISHOP, color)] = 0ull;
-	Bitboard bishopSliders = PieceBB(BISHOP, color);
+	attacksByPt[GetPiece(BISHOP, COLOR)] = 0ull;
+	Bitboard bishopSliders = PieceBB(BISHOP, COLOR);
 	while (bishopSliders) {
 		Square sq = lsb(bishopSliders);
 		Bitboard a = BishopTargets(sq, occupied);
-		dblAttacked[color] |= bbAttacks & a;
+		dblAttacked[COLOR] |= bbAttacks & a;
 		attacks[sq] = a;
 		bbAttacks |= a;
-		attacksByPt[GetPiece(BISHOP, color)] |= attacks[sq];
+		attacksByPt[GetPiece(BISHOP, COLOR)] |= attacks[sq];
 		bishopSliders &= bishopSliders - 1;
 	}
-	attacksByPt[GetPiece(QUEEN, color)] = 0ull;
-	Bitboard queenSliders = PieceBB(QUEEN, color);
+	attacksByPt[GetPiece(QUEEN, COLOR)] = 0ull;
+	Bitboard queenSliders = PieceBB(QUEEN, COLOR);
 	while (queenSliders) {
 		Square sq = lsb(queenSliders);
 		Bitboard a = RookTargets(sq, occupied);
 		a |= BishopTargets(sq, occupied);
-		dblAttacked[color] |= bbAttacks & a;
+		dblAttacked[COLOR] |= bbAttacks & a;
 		attacks[sq] = a;
 		bbAttacks |= a;
-		attacksByPt[GetPiece(QUEEN, color)] |= attacks[sq];
+		attacksByPt[GetPiece(QUEEN, COLOR)] |= attacks[sq];
 		queenSliders &= queenSliders - 1;
 	}
-	attacksByPt[GetPiece(KNIGHT, color)] = 0ull;
-	Bitboard knights = PieceBB(KNIGHT, color);
+	attacksByPt[GetPiece(KNIGHT, COLOR)] = 0ull;
+	Bitboard knights = PieceBB(KNIGHT, COLOR);
 	while (knights) {
 		Square sq = lsb(knights);
 		Bitboard a = KnightAttacks[sq];
-		dblAttacked[color] |= bbAttacks & a;
+		dblAttacked[COLOR] |= bbAttacks & a;
 		attacks[sq] = a;
 		bbAttacks |= a;
-		attacksByPt[GetPiece(KNIGHT, color)] |= attacks[sq];
+		attacksByPt[GetPiece(KNIGHT, COLOR)] |= attacks[sq];
 		knights &= knights - 1;
 	}
-	Square kingSquare = kingSquares[color];
+	Square kingSquare = kingSquares[COLOR];
 	attacks[kingSquare] = KingAttacks[kingSquare];
-	dblAttacked[color] |= bbAttacks & attacks[kingSquare];
+	dblAttacked[COLOR] |= bbAttacks & attacks[kingSquare];
 	bbAttacks |= attacks[kingSquare];
-	attacksByPt[GetPiece(KING, color)] = attacks[kingSquare];
-	attacksByPt[GetPiece(PAWN, color)] = 0ull;
-	Bitboard pawns = PieceBB(PAWN, color);
+	attacksByPt[GetPiece(KING, COLOR)] = attacks[kingSquare];
+	attacksByPt[GetPiece(PAWN, COLOR)] = 0ull;
+	Bitboard pawns = PieceBB(PAWN, COLOR);
 	while (pawns) {
 		Square sq = lsb(pawns);
-		Bitboard a = PawnAttacks[color][sq];
-		dblAttacked[color] |= bbAttacks & a;
+		Bitboard a = PawnAttacks[COLOR][sq];
+		dblAttacked[COLOR] |= bbAttacks & a;
 		attacks[sq] = a;
 		bbAttacks |= a;
-		attacksByPt[GetPiece(PAWN, color)] |= attacks[sq];
+		attacksByPt[GetPiece(PAWN, COLOR)] |= attacks[sq];
 		pawns &= pawns - 1;
 	}
 	return bbAttacks;
@@ -618,6 +827,7 @@ Bitboard Position::calculateAttacks(Color color) {
 
 //Battery attacks are squares attacked by rooks or queens backed by a Slider behind
 Bitboard Position::BatteryAttacks(Color attacking_color) const {
+	UpdateAttacks();
 	Bitboard bbXRay = EMPTY;
 	Bitboard bbRooks = OccupiedByColor[attacking_color] & (OccupiedByPieceType[QUEEN] | OccupiedByPieceType[ROOK]);
 	Bitboard bbExclRooks = OccupiedBB() & ~bbRooks;
@@ -789,7 +999,7 @@ Value Position::SEE(Move move) const
 }
 
 
-void Position::setFromFEN(const std::string& fen) {
+bool Position::setFromFEN(const std::string& fen) {
 	material = nullptr;
 	std::fill_n(Board, 64, BLANK);
 	OccupiedByColor[WHITE] = OccupiedByColor[BLACK] = 0ull;
@@ -797,7 +1007,6 @@ void Position::setFromFEN(const std::string& fen) {
 	EPSquare = OUTSIDE;
 	SideToMove = WHITE;
 	DrawPlyCount = 0;
-	AppliedMovesBeforeRoot = 0;
 	Hash = ZobristMoveColor;
 	PsqEval = EVAL_ZERO;
 	std::istringstream ss(fen);
@@ -813,10 +1022,15 @@ void Position::setFromFEN(const std::string& fen) {
 		else if (token == '/')
 			square -= 16;
 		else if ((piece = PieceToChar.find(token)) != std::string::npos) {
-			set<true>((Piece)piece, (Square)square);
+			if (square >= A1 && square <= H8) set<true>((Piece)piece, (Square)square);
 			square++;
 		}
 	}
+	//The king squares are needed everywhere, therefore positions without exactly one king per side are rejected
+	if (popcount(PieceBB(KING, WHITE)) != 1 || popcount(PieceBB(KING, BLACK)) != 1) {
+		setFromFEN("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+		return false;
+	}
 
 	kingSquares[WHITE] = lsb(PieceBB(KING, WHITE));
 	kingSquares[BLACK] = lsb(PieceBB(KING, BLACK));
@@ -957,16 +1171,20 @@ void Position::setFromFEN(const std::string& fen) {
 	pawn = pawn::probe(*this);
 	if (checkMaterialIsUnusual()) {
 		MaterialKey = MATERIAL_KEY_UNUSUAL;
-		material = initUnusual(*this);
+		material = probeUnusual(*this);
 	}
 	else {
 		MaterialKey = calculateMaterialKey();
 		material = probe(MaterialKey);
 	}
-	attackedByThem = calculateAttacks(Color(SideToMove ^ 1));
-	attackedByUs = calculateAttacks(SideToMove);
-	CalculatePinnedPieces();
+	calculateAttackMaps();
 	pliesFromRoot = 0;
+	historyIndex = 0;
+	pliesFromNull = 0;
+	hashHistory[0] = Hash;
+	bindMoveList();
+	moveList->movepointer = 0;
+	return true;
 }
 
 std::string Position::fen() const {
@@ -1059,8 +1277,8 @@ std::string Position::print() {
 
 std::string Position::printGeneratedMoves() {
 	std::ostringstream ss;
-	for (int i = 0; i < movepointer - 1; ++i) {
-		ss << toString(moves[i].move) << "\t" << (int)moves[i].score << "\n";
+	for (int i = 0; i < moveList->movepointer - 1; ++i) {
+		ss << toString(moveList->moves[i].move) << "\t" << (int)moveList->moves[i].score << "\n";
 	}
 	return ss.str();
 }
@@ -1121,14 +1339,10 @@ DetailedResult Position::GetDetailedResult() {
 		else {
 			//Check for 3 fold repetition
 			int repCounter = 0;
-			Position * prev = Previous();
-			for (int i = 0; i < (std::min(pliesFromRoot + AppliedMovesBeforeRoot, int(DrawPlyCount)) >> 1); ++i) {
-				prev = prev->Previous();
-				if (prev->GetHash() == GetHash()) {
-					repCounter++;
-					if (repCounter > 1) return DetailedResult::DRAW_REPETITION;
-					prev = prev->Previous();
-				}
+			const int end = std::min(pliesFromNull, int(DrawPlyCount));
+			for (int i = 4; i <= end; i += 2) {
+				if (hashHistory[(historyIndex - i) & (HASH_HISTORY_SIZE - 1)] == Hash && ++repCounter > 1)
+					return DetailedResult::DRAW_REPETITION;
 			}
 		}
 	}
@@ -1136,27 +1350,60 @@ DetailedResult Position::GetDetailedResult() {
 }
 
 bool Position::checkRepetition() const {
-	Position * prev = Previous();
-	for (int i = 0; i < (std::min(pliesFromRoot + AppliedMovesBeforeRoot, int(DrawPlyCount)) >> 1); ++i) {
-		prev = prev->Previous();
-		if (prev->GetHash() == GetHash())
+	//a position can't be repeated earlier than 4 plies after it has occurred
+	const int end = std::min(pliesFromNull, int(DrawPlyCount));
+	for (int i = 4; i <= end; i += 2) {
+		if (hashHistory[(historyIndex - i) & (HASH_HISTORY_SIZE - 1)] == Hash)
 			return true;
-		prev = prev->Previous();
 	}
 	return false;
 }
 
 bool Position::hasRepetition() const {
-	const Position * pos = this;
-	while (pos && pos->GetDrawPlyCount() > 0) {
-		if (pos->checkRepetition()) return true;
-		pos = pos->Previous();
+	//all positions since the last irreversible move are checked for duplicates by sorting their keys
+	const int count = std::min(pliesFromNull, int(DrawPlyCount)) + 1;
+	uint64_t keys[256];
+	for (int i = 0; i < count; ++i) keys[i] = hashHistory[(historyIndex - i) & (HASH_HISTORY_SIZE - 1)];
+	std::sort(keys, keys + count);
+	return std::adjacent_find(keys, keys + count) != keys + count;
+}
+
+bool Position::hasUpcomingRepetition(int ply) const {
+	//Cuckoo based detection as introduced by Marcel van Kervinck: if the key difference to an earlier position with the same side to move
+	//is the key difference of a reversible move, which isn't blocked, the earlier position can be reached by one move
+	const int end = std::min(pliesFromNull, int(DrawPlyCount));
+	if (end < 3) return false;
+	const Bitboard occupied = OccupiedBB();
+	for (int i = 3; i <= end; i += 2) {
+		const uint64_t moveKey = Hash ^ hashHistory[(historyIndex - i) & (HASH_HISTORY_SIZE - 1)];
+		int j = CuckooH1(moveKey);
+		if (CuckooKeys[j] != moveKey) {
+			j = CuckooH2(moveKey);
+			if (CuckooKeys[j] != moveKey) continue;
+		}
+		const Move move = CuckooMoves[j];
+		//Repetitions of positions before the root need to occur 3 times, therefore they are only counted within the search
+		if (ply > i && !(InBetweenFields[from(move)][to(move)] & occupied)) return true;
 	}
 	return false;
 }
 
+void Position::InitializeHashHistory() const {
+	const int end = std::min(pliesFromNull, int(DrawPlyCount));
+	const Position * pos = this;
+	for (int i = 0; i <= end && pos; ++i) {
+		hashHistory[(historyIndex - i) & (HASH_HISTORY_SIZE - 1)] = pos->Hash;
+		pos = pos->previous;
+	}
+}
+
+void Position::RestoreHashHistoryEntry() const {
+	hashHistory[historyIndex & (HASH_HISTORY_SIZE - 1)] = Hash;
+}
+
 //Hashmoves, countermoves, ... aren't really reliable => therefore check if it is a valid move
 bool Position::validateMove(Move move) {
+	UpdateAttacks();
 	Square fromSquare = from(move);
 	Piece movingPiece = Board[fromSquare];
 	Square toSquare = to(move);
@@ -1273,15 +1520,18 @@ bool Position::validateMove(ExtendedMove move) {
 }
 
 
-void Position::NullMove(Square epsquare, Move lastApplied) {
+void Position::NullMove(Square epsquare, Move lastApplied, int pliesFromNull) {
+	UpdateAttacks();
 	SwitchSideToMove();
 	SetEPSquare(epsquare);
+	this->pliesFromNull = pliesFromNull;
+	hashHistory[historyIndex & (HASH_HISTORY_SIZE - 1)] = Hash;
 	lastAppliedMove = lastApplied;
 	Bitboard tmp = attackedByThem;
 	attackedByThem = attackedByUs;
 	attackedByUs = tmp;
 	if (StaticEval != VALUE_NOTYETDETERMINED) {
-		StaticEval = -StaticEval + 2 * settings::parameter.BONUS_TEMPO.getScore(material->Phase);
+		StaticEval = -StaticEval + 2 * settings::parameter.BONUS_TEMPO.getScore(GetMaterialTableEntry()->Phase);
 	}
 }
 
@@ -1303,8 +1553,9 @@ bool Position::checkMaterialIsUnusual() const {
 
 ValuatedMove * Position::GenerateForks(bool withChecks)
 {
-	movepointer -= (movepointer != 0);
-	ValuatedMove * firstMove = &moves[movepointer];
+	UpdateAttacks();
+	moveList->movepointer -= (moveList->movepointer != 0);
+	ValuatedMove * firstMove = &moveList->moves[moveList->movepointer];
 	Bitboard knights = PieceBB(KNIGHT, SideToMove);
 	Bitboard targets;
 	Bitboard forkTargets;
@@ -1339,7 +1590,7 @@ ValuatedMove * Position::GenerateForks(bool withChecks)
 
 bool Position::mateThread() const
 {
-	Bitboard bbEscapeSquares = GetAttacksFrom(kingSquares[SideToMove ^ 1]) & ~ColorBB(Color(SideToMove ^ 1)) & ~attackedByUs;
+	Bitboard bbEscapeSquares = GetAttacksFrom(kingSquares[SideToMove ^ 1]) & ~ColorBB(Color(SideToMove ^ 1)) & ~AttackedByUs();
 	int countEscapeSquares = popcount(bbEscapeSquares);
 	return (countEscapeSquares <= 1); //At most one escape square
 		//|| (countEscapeSquares == 2  && (bbEscapeSquares & (Rank1 | Rank8)) == bbEscapeSquares); //Backrank mate
@@ -1423,7 +1674,7 @@ Move Position::parseSan(std::string move) {
 }
 
 std::string Position::printEvaluation() {
-	if (material->EvaluationFunction == &evaluateDefault) {
+	if (GetMaterialTableEntry()->EvaluationFunction == &evaluateDefault) {
 		return printDefaultEvaluation(*this);
 	}
 	else {
@@ -1436,7 +1687,7 @@ std::string Position::printEvaluation() {
 	}
 }
 
-void Position::CalculatePinnedPieces()
+void Position::CalculatePinnedPieces() const
 {
 	for (int colorOfKing = 0; colorOfKing < 2; ++colorOfKing) {
 		bbPinned[colorOfKing] = EMPTY;
@@ -1454,4 +1705,5 @@ void Position::CalculatePinnedPieces()
 			pinner &= pinner - 1;
 		}
 	}
+	pinnedOutdated = false;
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <algorithm>
 #include "types.h"
 #include "board.h"
 #include "material.h"
@@ -24,11 +25,84 @@ const int generationPhaseOffset[] = { 0, //Main Search
 22, //Repeat
 24  //All moves
 };
+//State of the staged move generation of a position (see Position::InitializeMoveIterator and Position::NextMove)
+struct MoveIterator {
+	//number of generated moves in moves array
+	int movepointer;
+	//indices needed to manage staged move generation
+	int moveIterationPointer;
+	int phaseStartIndex;
+	int generationPhase;
+	//Information needed for move ordering during staged move generation
+	Move hashMove;
+	killer::Manager *killerManager;
+	HistoryManager * history;
+	MoveSequenceHistoryManager * cmHistory;
+	MoveSequenceHistoryManager * followupHistory;
+	Move counterMove;
+	ValuatedMove * firstNegative;
+	bool canPromote;
+	uint32_t processedMoveGenerationPhases;
+};
+
+//Generated moves of a position together with the state of their staged generation
+struct MoveList : MoveIterator {
+	ValuatedMove moves[MAX_MOVE_COUNT];
+};
+
+//The move stack is sized for the deepest search path (the killer tables don't support deeper searches anyway)
+const int MOVE_STACK_SIZE = 2 * MAX_DEPTH;
+
+/* Storage for the move lists of a thread. A position doesn't carry its move list, but uses the list of the thread's move stack
+   indexed by its number of plies from the root. Positions at the same ply share their move list, therefore a search done at the
+   same ply (like IID or ProbCut) has to be finished before the position starts its own staged move generation.
+   Search threads use the move stack of their ThreadData, all other threads a default stack of their own */
+struct MoveStack {
+	MoveList lists[MOVE_STACK_SIZE];
+};
+
+//Makes the calling thread use stack (nullptr: the thread's default stack) for all positions it creates or assigns subsequently
+void registerMoveStack(MoveStack * stack);
+
+#ifdef MAKE_UNMAKE
+//Make/unmake (see Position::DoMove): state of a position, which can't be recalculated when taking back a move, and information about
+//the position needed by its successors, as they can't access it via Position::Previous() while they are searched in place.
+//Attack maps and pinned pieces aren't saved, they are recalculated when needed after the move has been taken back
+struct UndoInfo {
+	uint64_t Hash;
+	MaterialKey_t MaterialKey;
+	PawnKey_t PawnKey;
+	Square EPSquare;
+	unsigned char CastlingOptions;
+	unsigned char DrawPlyCount;
+	Piece capturedInLastMove;
+	Move lastAppliedMove;
+	//piece on the target square of lastAppliedMove (the piece which moved last)
+	Piece lastMovingPiece;
+	Result result;
+	Value StaticEval;
+	MaterialTableEntry * material;
+	pawn::Entry * pawn;
+	MoveList * moveList;
+	//squares attacked by the side to move (only valid if the attack maps were up to date, when the move was done)
+	Bitboard attackedByUs;
+	bool attackedByUsValid;
+};
+
+//Like the move stack the undo stack is sized for the deepest search path
+const int UNDO_STACK_SIZE = MOVE_STACK_SIZE;
+#endif
+
+//Size of the per-thread ring buffer of hash keys of the current position and its ancestors (game history and search path). Repetition
+//checks look back at most DrawPlyCount plies, so the size has to exceed the maximal DrawPlyCount plus the maximal search depth
+const int HASH_HISTORY_SIZE = 1024;
+
 /* Represents a chess position and provides information about lots of characteristics of this position
    The position is represented by 8 Bitboards (2 for squares occupied by color, and 6 for each piece type)
    Further there is a redundant 64 byte array for fast lookup which piece is on a given square
    Each position contains a pointer to the previous position, which is created when copying the position
-   Applying a move is done by first copying the position and then calling ApplyMove
+   Applying a move is done by first copying the position and then calling ApplyMove (if MAKE_UNMAKE is defined the search applies moves
+   in place by calling DoMove and takes them back by UndoMove instead)
 */
 struct Position
 {
@@ -41,10 +115,10 @@ public:
 	  ATTENTION: Only parts of the position are copied. To have a full copy a further call to copy() method is needed
 	*/
 	Position(Position &pos);
+	//Full copy of a position (the generated moves are copied as well, unless both positions share their move list)
+	Position & operator=(const Position &pos);
 	~Position();
 
-	//Moves already played within a game before searched position is reached
-	static int AppliedMovesBeforeRoot;
 	//Access methods to the positions bitboards
 	Bitboard PieceBB(const PieceType pt, const Color c) const;
 	Bitboard ColorBB(const Color c) const;
@@ -59,10 +133,19 @@ public:
 	std::string printGeneratedMoves();
 	//returns current position as FEN string
 	std::string fen() const;
-	//initializes the position from given FEN string
-	void setFromFEN(const std::string& fen);
+	//initializes the position from given FEN string. Returns false (and initializes the start position instead), if fen doesn't contain
+	//exactly one king per side
+	bool setFromFEN(const std::string& fen);
 	//Applies a pseudo-legal move and returns true if move is legal
 	bool ApplyMove(Move move);
+#ifdef MAKE_UNMAKE
+	/*Make/unmake alternative to copy/make: DoMove applies a pseudo-legal move in place (and returns true if the move is legal) after having
+	  saved the state of the position on a per-thread undo stack. UndoMove takes back the last move done by DoMove, it has to be called as
+	  well, if DoMove returned false. The successor uses the move list of its ply, so that the staged move generation can be continued afterwards.
+	  Attack maps and pinned pieces have to be recalculated after UndoMove, when they are needed again */
+	bool DoMove(Move move);
+	void UndoMove(Move move);
+#endif
 	//"Undo move" by returning pointer to previous position
 	inline Position * Previous() const { return previous; }
 	//Generate moves and store it in moves array
@@ -83,8 +166,18 @@ public:
 	Value SEE(Move move) const;
 	//SEE method, which returns without exact value, when it's sure that value is positive (then VALUE_KNOWN_WIN is returned)
 	Value SEE_Sign(Move move) const;
-	//returns true if SideTo Move is in check. Must not be called when it's unclear whether opponent's attack map is already determined
-	inline bool Checked() const { return (attackedByThem & PieceBB(KING, SideToMove)) != EMPTY; }
+	//returns true if SideTo Move is in check. As long as the attack maps aren't calculated, the attackers of the king are determined directly
+	inline bool Checked() const {
+		if (attacksOutdated) return IsAttacked(kingSquares[SideToMove], Color(SideToMove ^ 1));
+		return (attackedByThem & PieceBB(KING, SideToMove)) != EMPTY;
+	}
+	//checks if a square is attacked by any piece of the given side (without needing the attack maps)
+	inline bool IsAttacked(Square square, Color attackingSide) const { return IsAttacked(square, attackingSide, OccupiedByColor[attackingSide], OccupiedBB()); }
+	//checks if a square is attacked by one of the attackers (pieces of attackingSide) given the occupancy of the board
+	inline bool IsAttacked(Square square, Color attackingSide, Bitboard attackers, Bitboard occupied) const;
+	//Attack maps and pinned pieces are calculated on demand, as many positions (like illegal or cut-off positions) don't need them.
+	//All accessors of attack information call this method.
+	inline void UpdateAttacks() const { if (attacksOutdated) calculateAttackMaps(); }
 	//Static evaluation function for unusual material (no pre-calculated material values available in Material Table)
 	friend Evaluation evaluateFromScratch(Position &pos);
 	//Calls the static evaluation function (it will call the evaluation even, if the StaticEval value is already different from VALUE_NOTYETEVALUATED)
@@ -93,53 +186,85 @@ public:
 	std::string printEvaluation();
 	//Evaluates final positions
 	inline Value evaluateFinalPosition();
-	inline int GeneratedMoveCount() const { return movepointer - 1; }
+	inline int GeneratedMoveCount() const { return moveList->movepointer - 1; }
 	//Returns the number of plies applied from the root position of the search
 	inline int GetPliesFromRoot() const { return pliesFromRoot; }
+	inline int GetPliesFromNull() const { return pliesFromNull; }
 	inline Color GetSideToMove() const { return SideToMove; }
 	inline Piece GetPieceOnSquare(Square square) const { return Board[square]; }
 	inline Square GetEPSquare() const { return EPSquare; }
 	//gives access to the moves of the currently processed stage
-	inline ValuatedMove * GetMovesOfCurrentPhase() { return &moves[phaseStartIndex]; }
+	inline ValuatedMove * GetMovesOfCurrentPhase() { return &moveList->moves[moveList->phaseStartIndex]; }
 	//Within staged move generation this method returns the index of the current move within the current stage. This is needed for
 	//updating the history table
-	inline int GetMoveNumberInPhase() const { return moveIterationPointer; }
-	inline Value GetMaterialScore() const { return material->Score(); }
-	inline MaterialTableEntry * GetMaterialTableEntry() const { return material; }
-	inline pawn::Entry * GetPawnEntry() const { return pawn; }
-	inline Value GetPawnScore() const { return pawn->Score.getScore(material->Phase); }
-	inline void InitMaterialPointer() { material = probe(MaterialKey); }
-	inline Eval PawnStructureScore() const { return pawn->Score; }
+	inline int GetMoveNumberInPhase() const { return moveList->moveIterationPointer; }
+	inline Value GetMaterialScore() const { return GetMaterialTableEntry()->Score(); }
+	//Entries for unusual material are verified against the material hash, as they might have been overwritten by a probe in a subsequent position
+	inline MaterialTableEntry * GetMaterialTableEntry() const {
+		if (MaterialKey == MATERIAL_KEY_UNUSUAL && static_cast<UnusualMaterialEntry *>(material)->Key != GetMaterialHashUnusual()) material = probeUnusual(*this);
+		return material;
+	}
+	//The entry is verified against the pawn key, as it might have been overwritten by a probe in a subsequent position
+	inline pawn::Entry * GetPawnEntry() const {
+		if (pawn->Key != PawnKey) pawn = pawn::probe(*this);
+		return pawn;
+	}
+	inline Value GetPawnScore() const { return GetPawnEntry()->Score.getScore(GetMaterialTableEntry()->Phase); }
+	inline void InitMaterialPointer() { material = MaterialKey == MATERIAL_KEY_UNUSUAL ? probeUnusual(*this) : probe(MaterialKey); }
+	inline Eval PawnStructureScore() const { return GetPawnEntry()->Score; }
 	//checks if the position is final and returns the result
 	Result GetResult();
 	//for xboard protocol support it's helpful, to not only know that a position is a DRAW but also why it's a draw. Therefore this additional
 	//method will return a more detailed result value
 	DetailedResult GetDetailedResult();
 	//returns a bitboard indicating the squares attacked by the piece on the given square 
-	inline Bitboard GetAttacksFrom(Square square) const { return attacks[square]; }
+	inline Bitboard GetAttacksFrom(Square square) const { UpdateAttacks(); return attacks[square]; }
 	inline void SetPrevious(Position &pos) { previous = &pos; }
 	inline void SetPrevious(Position *pos) { previous = pos; }
 	//Should be called before search starts
-	inline void ResetPliesFromRoot() { pliesFromRoot = 0; }
+	inline void ResetPliesFromRoot() { pliesFromRoot = 0; bindMoveList(); }
 	inline Bitboard AttacksByPieceType(Color color, PieceType pieceType) const;
 	inline Bitboard AttacksExcludingPieceType(Color color, PieceType excludedPieceType) const;
-	inline Bitboard AttacksByColor(Color color) const { return (SideToMove == color) * attackedByUs + (SideToMove != color) * attackedByThem; }
-	inline Bitboard AttackedByThem() const { return attackedByThem; }
-	inline Bitboard AttackedByUs() const { return attackedByUs; }
+	inline Bitboard AttacksByColor(Color color) const { UpdateAttacks(); return (SideToMove == color) * attackedByUs + (SideToMove != color) * attackedByThem; }
+	inline Bitboard AttackedByThem() const { UpdateAttacks(); return attackedByThem; }
+	inline Bitboard AttackedByUs() const { UpdateAttacks(); return attackedByUs; }
 	//checks if the position is already repeated (if one of the ancestors has the same zobrist hash). This is no check for 3-fold repetition!
 	bool checkRepetition() const;
 	//checks if there are any repetitions in prior moves
 	bool hasRepetition() const;
+	//checks if the side to move can reach a position, which is a repetition of an earlier position within the search (at least ply plies
+	//before). Only reversible moves of pieces are considered, so that a repetition might be reached by the next move
+	bool hasUpcomingRepetition(int ply) const;
+	//Writes the hash keys of this position and its ancestors back to the last irreversible move to the hash history of the calling thread.
+	//Has to be called by each thread before it starts searching from this position
+	void InitializeHashHistory() const;
+	//Writes this position's hash key back to its hash history entry, which a search from a sibling position has overwritten
+	void RestoreHashHistoryEntry() const;
+	//State of the staged move generation. A search done at the same ply after the move generation has started (like the singular
+	//extension search of the hash move, which is returned before any move is generated) overwrites it and has to restore it afterwards
+	inline MoveIterator GetMoveIterator() const { return *moveList; }
+	inline void SetMoveIterator(const MoveIterator & iterator) { static_cast<MoveIterator &>(*moveList) = iterator; }
 	inline void SwitchSideToMove() { SideToMove = Color(SideToMove ^ 1); Hash ^= ZobristMoveColor; }
 	inline unsigned char GetDrawPlyCount() const { return DrawPlyCount; }
-	//applies a null move to the given position (there is no copy/make for null move), the EPSquare is the only information which has to be restored afterwards
-	void NullMove(Square epsquare = OUTSIDE, Move lastApplied = MOVE_NONE);
+	//applies a null move to the given position (there is no copy/make for null move), the EPSquare, the last applied move and the number of plies
+	//since the last null move are the only information which has to be restored afterwards
+	void NullMove(Square epsquare = OUTSIDE, Move lastApplied = MOVE_NONE, int pliesFromNull = 0);
 	//delete all ancestors of the current positions and frees the assigned memory
 	void deleteParents();
 	//returns the last move applied, which lead to this position
 	inline Move GetLastAppliedMove() const { return lastAppliedMove; }
 	//get's the piece, which moved in the last applied move
-	inline Piece GetPreviousMovingPiece() const { if (previous && lastAppliedMove != MOVE_NONE) return previous->GetPieceOnSquare(to(lastAppliedMove)); else return BLANK; }
+	Piece GetPreviousMovingPiece() const;
+	//Information about the previous positions. Positions searched in place (see DoMove) take it from the undo stack, therefore the search
+	//has to use these methods instead of accessing the previous position via Previous():
+	//returns the last move applied to the previous position
+	Move GetPreviousLastAppliedMove() const;
+	//returns the piece on the target square of the last move applied to the previous position (castling moves fixed by FixCastlingMove)
+	Piece GetPreviousLastMovingPiece() const;
+	//returns the squares attacked by the side to move in the previous position (with make/unmake only if they had been calculated there)
+	Bitboard GetPreviousAttackedByUs() const;
+	//returns false if there is no position plies plies before this one, otherwise its static evaluation is returned in staticEval
+	bool GetAncestorStaticEval(int plies, Value & staticEval) const;
 	//returns the piece, which has been captured by the last applied move
 	inline Piece getCapturedInLastMove() const { if (lastAppliedMove == MOVE_NONE) return Piece::BLANK; else return capturedInLastMove; }
 	//checks if a move is quiet (move is neither capture, nor promotion)
@@ -173,32 +298,36 @@ public:
 	//parses a move in SAN notation
 	Move parseSan(std::string move);
 	Move GetCounterMove(Move(&counterMoves)[12][64]);
-	inline bool Improved() { return previous == nullptr || previous->previous == nullptr || StaticEval >= previous->previous->StaticEval; }
-	inline bool Worsening() { return previous != nullptr && previous->previous != nullptr && StaticEval <= previous->previous->StaticEval - Value(10); }
+	inline bool Improved() { Value ancestorEval; return !GetAncestorStaticEval(2, ancestorEval) || StaticEval >= ancestorEval; }
+	inline bool Worsening() { Value ancestorEval; return GetAncestorStaticEval(2, ancestorEval) && StaticEval <= ancestorEval - Value(10); }
 	//During staged move generation first only queen promotions are generated. When all other moves are generated and processed under promotions will be added
 	void AddUnderPromotions();
-	inline ValuatedMove * GetMoves(int & moveCount) { moveCount = movepointer - 1; return moves; }
-	inline void ResetMoveGeneration() { movepointer = 0; moves[0].move = MOVE_NONE; moves[0].score = VALUE_NOTYETDETERMINED; }
+	inline ValuatedMove * GetMoves(int & moveCount) { moveCount = moveList->movepointer - 1; return moveList->moves; }
+	inline void ResetMoveGeneration() { moveList->movepointer = 0; moveList->moves[0].move = MOVE_NONE; moveList->moves[0].score = VALUE_NOTYETDETERMINED; }
 	//Some moves (like moves from transposition tables) have to be validated (checked for legality) before being applied
 	bool validateMove(Move move);
 	//For pruning decisions it's necessary to identify whether or not all special movee (like killer,..) are already returned
-	inline bool QuietMoveGenerationPhaseStarted() const { return generationPhases[generationPhase] >= QUIETS_POSITIVE; }
-	inline bool MoveGenerationPhasePassed(MoveGenerationType phase) const { return (processedMoveGenerationPhases & (1 << (int)phase)) != 0; }
-	inline MoveGenerationType GetMoveGenerationPhase() const { return generationPhases[generationPhase]; }
+	inline bool QuietMoveGenerationPhaseStarted() const { return generationPhases[moveList->generationPhase] >= QUIETS_POSITIVE; }
+	inline bool MoveGenerationPhasePassed(MoveGenerationType phase) const { return (moveList->processedMoveGenerationPhases & (1 << (int)phase)) != 0; }
+	inline MoveGenerationType GetMoveGenerationPhase() const { return generationPhases[moveList->generationPhase]; }
 	//Validate a move and return it if validated, else return another valid move
 	Move validMove(Move proposedMove);
 	//Checks if a move gives check
 	bool givesCheck(Move move);
+	//Checks if a pseudo-legal move is legal without applying it (using the pinned pieces and the attackers of the king, but not the full attack maps)
+	inline bool isLegal(Move move) const;
 	//Get Pinned Pieces
-	inline Bitboard PinnedPieces(Color colorOfKing) const { return bbPinned[colorOfKing]; }
-	void CalculatePinnedPieces();
+	inline Bitboard PinnedPieces(Color colorOfKing) const { UpdatePinnedPieces(); return bbPinned[colorOfKing]; }
+	void CalculatePinnedPieces() const;
+	//Pinned pieces are cheaper than the attack maps and are therefore calculated on their own, if only they are needed
+	inline void UpdatePinnedPieces() const { if (pinnedOutdated) CalculatePinnedPieces(); }
 	inline Square KingSquare(Color color) const { return kingSquares[color]; }
 	//Check for opposite colored bishops
 	bool oppositeColoredBishops() const;
 	//Check if there is a mate threat (a possibility that there might be a quiet move giving mate)
 	bool mateThread() const;
 	//Bitboard of squares attacked by more than one piece
-	inline Bitboard dblAttacks(Color color) const { return dblAttacked[color]; }
+	inline Bitboard dblAttacks(Color color) const { UpdateAttacks(); return dblAttacked[color]; }
 	//CHeck if kings are on opposed wings 
 	inline bool KingOnOpposedWings() const { return ((CastlingOptions & 15) == 0) && std::abs((kingSquares[WHITE] & 7) - (kingSquares[BLACK] & 7)) > 2; }
 	Bitboard BatteryAttacks(Color attacking_color) const;
@@ -220,6 +349,11 @@ private:
 	unsigned char DrawPlyCount;
 	Color SideToMove;
 	int pliesFromRoot;
+	//Index of the position's hash key within the hash history (number of moves applied since the position was set up from FEN)
+	int historyIndex;
+	//Number of moves applied since the last null move (or since the position was set up from FEN). Repetitions are only searched within
+	//these plies, as the hash history has no entry for the null move itself and positions before a null move can't be reached again
+	int pliesFromNull;
 	Piece Board[64];
 	Eval PsqEval;
 	//King Squares
@@ -227,50 +361,48 @@ private:
 
 	//Pointer to the previous position
 	Position * previous = nullptr;
+#ifdef MAKE_UNMAKE
+	//Number of moves done in place by DoMove and not yet taken back. Their undo information is on the undo stack, the information of the
+	//last one at index undoTop - 1
+	int undoCount = 0;
+	int undoTop;
+#endif
 
 	//These members are only calculated when needed
 	//Pointer to the relevant entry in the Material table
-	MaterialTableEntry * material;
+	mutable MaterialTableEntry * material;
 	//Pointer to the relevant entry in the pawn hash table
-	pawn::Entry * pawn;
-	//array to store the generated moves
-	ValuatedMove moves[MAX_MOVE_COUNT];
-	//number of generated moves in moves array
-	int movepointer = 0;
+	mutable pawn::Entry * pawn;
+	//generated moves and state of the staged move generation (stored in the thread's move stack, see MoveStack)
+	MoveList * moveList;
+	//true as long as the attack information below hasn't been calculated for the current placement of pieces
+	mutable bool attacksOutdated = true;
+	//true as long as bbPinned and bbPinner haven't been calculated for the current placement of pieces
+	mutable bool pinnedOutdated = true;
 	//Attack array - index is Square number, value is a bitboard indicating all squares attacked by a piece on that square
-	Bitboard attacks[64];
+	mutable Bitboard attacks[64];
 	//Attack bitboard containing all squares attacked by the side not to move
-	Bitboard attackedByThem;
+	mutable Bitboard attackedByThem;
 	//Attack bitboard containing all squares attacked by the side to move
-	Bitboard attackedByUs;
+	mutable Bitboard attackedByUs;
 	//Attack bitboard containing all squares attacked by at least 2 pieces (indexed by attacking color)
-	Bitboard dblAttacked[2] = { EMPTY, EMPTY };
+	mutable Bitboard dblAttacked[2] = { EMPTY, EMPTY };
 	//Attack bitboard containing all attacks by a certain Piece Type
-	Bitboard attacksByPt[12];
+	mutable Bitboard attacksByPt[12];
 	//Bitboards of pieces pinned to king of given Color: bbPinned[0] contains white an black pieces "pinned" to white king
-	Bitboard bbPinned[2] = { EMPTY, EMPTY };
-	Bitboard bbPinner[2];
+	mutable Bitboard bbPinned[2] = { EMPTY, EMPTY };
+	mutable Bitboard bbPinner[2];
 
-	//indices needed to manage staged move generation
-	int moveIterationPointer;
-	int phaseStartIndex;
-	int generationPhase;
 	//Result of position (value will be OPEN unless position is final)
 	Result result = Result::RESULT_UNKNOWN;
 	//Static evaluation of position
 	Value StaticEval = VALUE_NOTYETDETERMINED;
-	//Information needed for move ordering during staged move generation
-	Move hashMove = MOVE_NONE;
-	killer::Manager *killerManager;
 	Move lastAppliedMove = MOVE_NONE;
 	Piece capturedInLastMove = BLANK;
-	HistoryManager * history;
-	MoveSequenceHistoryManager * cmHistory;
-	MoveSequenceHistoryManager * followupHistory;
-	Move counterMove = MOVE_NONE;
-	ValuatedMove * firstNegative;
-	bool canPromote = false;
-	uint32_t processedMoveGenerationPhases;
+	//Copies the placement of the pieces and the state information (the members up to previous)
+	void copyBoard(const Position &pos);
+	//Points moveList to the list of the thread's move stack belonging to the position's ply
+	void bindMoveList();
 	//Place a piece on Squarre square and update bitboards and Hash key
 	template<bool SquareIsEmpty> void set(const Piece piece, const Square square);
 	void remove(const Square square);
@@ -302,18 +434,23 @@ private:
 		}
 	}
 	inline int PawnStep() const { return 8 - 16 * SideToMove; }
+	//Move generators specialized for the side to move, GenerateMoves dispatches to them
+	template<MoveGenerationType MGT, Color US> ValuatedMove * generateMoves();
+	template<Color US> ValuatedMove * generateQuietChecks();
 	//Add a move to the move list and increment movepointer
 	inline void AddMove(Move move) {
-		moves[movepointer].move = move;
-		moves[movepointer].score = VALUE_NOTYETDETERMINED;
-		++movepointer;
+		moveList->moves[moveList->movepointer].move = move;
+		moveList->moves[moveList->movepointer].score = VALUE_NOTYETDETERMINED;
+		++moveList->movepointer;
 	}
 	//Adds MOVE_NONE at the end of the move list
-	inline void AddNullMove() { moves[movepointer].move = MOVE_NONE; moves[movepointer].score = VALUE_NOTYETDETERMINED; ++movepointer; }
+	inline void AddNullMove() { moveList->moves[moveList->movepointer].move = MOVE_NONE; moveList->moves[moveList->movepointer].score = VALUE_NOTYETDETERMINED; ++moveList->movepointer; }
 	//Updates Castle Flags after a move from fromSquare to toSquare has been applied, must not be called for castling moves
 	void updateCastleFlags(Square fromSquare, Square toSquare);
 	//Calculates the attack bitboards for all pieces of one side
-	Bitboard calculateAttacks(Color color);
+	template<Color COLOR> Bitboard calculateAttacks() const;
+	//Calculates the attack bitboards of both sides and the pinned pieces
+	void calculateAttackMaps() const;
 	//Calculates Bitboards of pieces blocking a check. If colorOfBlocker = kingColor, these are the pinned pieces, else these are candidates for discovered checks
 	Bitboard checkBlocker(Color colorOfBlocker, Color kingColor);
 	//Calculates the material key of this position
@@ -335,11 +472,12 @@ private:
 	Bitboard AttacksOfField(const Square targetField, const Bitboard occupied) const;
 	Bitboard AttacksOfField(const Square targetField, const Color attackingSide) const;
 	//Checks is a oseudo-legal move is valid
-	inline bool isValid(Move move) { Position next(*this); return next.ApplyMove(move); }
+	inline bool isValid(Move move) { return isLegal(move); }
 	//Checks if a move (e.g. from killer move list) is a valid move
 	bool validateMove(ExtendedMove move);
 	//Checks if at least one valid move exists - ATTENTION must not be called on a newly initialized position where attackedByThem isn't calculated yet!!
 	template<bool CHECKED> bool CheckValidMoveExists();
+	template<bool CHECKED, Color US> bool checkValidMoveExists();
 	//Checks for unusual Material (this means one side has more than one Queen or more than 2 rooks, knights or bishop)
 	bool checkMaterialIsUnusual() const;
 	//Generates quiet and tactical moves like forks
@@ -359,6 +497,21 @@ inline Bitboard Position::PieceBB(const PieceType pt, const Color c) const { ret
 inline Bitboard Position::ColorBB(const Color c) const { return OccupiedByColor[c]; }
 inline Bitboard Position::ColorBB(const int c) const { return OccupiedByColor[c]; }
 inline Bitboard Position::OccupiedBB() const { return OccupiedByColor[WHITE] | OccupiedByColor[BLACK]; }
+
+//Squares from which a pawn of the given color attacks the square (PawnAttacks can't be used as it's only defined for pawn squares)
+inline Bitboard PawnSourceSquares(Square square, Color pawnColor) {
+	Bitboard squareBB = ToBitboard(square);
+	return pawnColor == WHITE ? ((squareBB >> 7) & NOT_A_FILE) | ((squareBB >> 9) & NOT_H_FILE)
+		: ((squareBB << 7) & NOT_H_FILE) | ((squareBB << 9) & NOT_A_FILE);
+}
+
+inline bool Position::IsAttacked(Square square, Color attackingSide, Bitboard attackers, Bitboard occupied) const {
+	return (KnightAttacks[square] & attackers & OccupiedByPieceType[KNIGHT])
+		|| (PawnSourceSquares(square, attackingSide) & attackers & OccupiedByPieceType[PAWN])
+		|| (KingAttacks[square] & attackers & OccupiedByPieceType[KING])
+		|| (RookTargets(square, occupied) & attackers & (OccupiedByPieceType[ROOK] | OccupiedByPieceType[QUEEN]))
+		|| (BishopTargets(square, occupied) & attackers & (OccupiedByPieceType[BISHOP] | OccupiedByPieceType[QUEEN]));
+}
 inline Bitboard Position::PieceTypeBB(const PieceType pt) const { return OccupiedByPieceType[pt]; }
 
 inline bool Position::IsWinningCapture(const ValuatedMove& move) const {
@@ -366,6 +519,38 @@ inline bool Position::IsWinningCapture(const ValuatedMove& move) const {
 		|| type(move.move) == ENPASSANT || type(move.move) == PROMOTION;
 }
 
+inline bool Position::isLegal(Move move) const {
+	const Square fromSquare = from(move);
+	const Square toSquare = to(move);
+	const Square kingSquare = kingSquares[SideToMove];
+	const Color them = Color(SideToMove ^ 1);
+	switch (type(move)) {
+	case ENPASSANT: {
+		//Check for attacks on the king through the squares left by both pawns
+		Square capturedPawnSquare = Square(toSquare - PawnStep());
+		Bitboard occupied = (OccupiedBB() ^ ToBitboard(fromSquare) ^ ToBitboard(capturedPawnSquare)) | ToBitboard(toSquare);
+		return !IsAttacked(kingSquare, them, OccupiedByColor[them] & ~ToBitboard(capturedPawnSquare), occupied);
+	}
+	case CASTLING: {
+		const bool shortCastling = toSquare == G1 + (SideToMove * 56) || toSquare == InitialRookSquare[2 * SideToMove];
+		const Square kingTo = Square((shortCastling ? G1 : C1) + (SideToMove * 56));
+		const Square rookTo = Square(kingTo + (shortCastling ? -1 : 1));
+		Bitboard occupied = OccupiedBB() & ~ToBitboard(fromSquare) & ~ToBitboard(InitialRookSquare[2 * SideToMove + !shortCastling]);
+		return !IsAttacked(kingTo, them, OccupiedByColor[them], occupied | ToBitboard(kingTo) | ToBitboard(rookTo));
+	}
+	default:
+		if (fromSquare == kingSquare) return !IsAttacked(toSquare, them, OccupiedByColor[them], OccupiedBB() ^ ToBitboard(fromSquare));
+		if (Checked()) {
+			//Only single checks can be resolved by capturing the checker or by blocking
+			Bitboard checkers = AttacksOfField(kingSquare, them);
+			if (checkers & (checkers - 1)) return false;
+			if (!(ToBitboard(toSquare) & (checkers | InBetweenFields[lsb(checkers)][kingSquare]))) return false;
+		}
+		//pinned pieces may only move along the pin ray
+		return !(PinnedPieces(SideToMove) & ToBitboard(fromSquare)) || (RaysBySquares[kingSquare][fromSquare] & ToBitboard(toSquare));
+	}
+}
+
 inline PieceType Position::GetMostValuablePieceType(Color color) const {
 	if (MaterialKey != MATERIAL_KEY_UNUSUAL) return material->GetMostExpensivePiece(color);
 	else {
@@ -380,6 +565,7 @@ inline PieceType Position::GetMostValuablePieceType(Color color) const {
 }
 
 inline PieceType Position::GetMostValuableAttackedPieceType() const {
+	UpdateAttacks();
 	Color col = Color(SideToMove ^ 1);
 	PieceType ptstart = MaterialKey != MATERIAL_KEY_UNUSUAL ? material->GetMostExpensivePiece(col) : QUEEN;
 	for (PieceType pt = ptstart; pt < KING; ++pt) {
@@ -392,7 +578,8 @@ inline Value Position::evaluate() {
 	if (StaticEval != VALUE_NOTYETDETERMINED)
 		return StaticEval;
 	if (GetResult() == Result::OPEN) {
-		 return StaticEval = material->EvaluationFunction(*this) + settings::parameter.BONUS_TEMPO.getScore(material->Phase);
+		 const MaterialTableEntry * entry = GetMaterialTableEntry();
+		 return StaticEval = entry->EvaluationFunction(*this) + settings::parameter.BONUS_TEMPO.getScore(entry->Phase);
 	}
 	else if (result == Result::DRAW) return StaticEval = VALUE_DRAW;
 	else
@@ -407,11 +594,17 @@ inline Value Position::evaluateFinalPosition() {
 
 //Tries to find one valid move as fast as possible
 template<bool CHECKED> bool Position::CheckValidMoveExists() {
-	assert(attackedByThem); //should have been already calculated
+	return SideToMove == WHITE ? checkValidMoveExists<CHECKED, WHITE>() : checkValidMoveExists<CHECKED, BLACK>();
+}
+
+template<bool CHECKED, Color US> bool Position::checkValidMoveExists() {
+	const Color THEM = Color(US ^ 1);
+	const int pawnStep = US == WHITE ? 8 : -8;
+	UpdateAttacks();
 	//Start with king (Castling need not be considered - as there is always another legal move available with castling
 	//In Chess960 this might be different)
-	Square kingSquare = kingSquares[SideToMove];
-	Bitboard kingTargets = KingAttacks[kingSquare] & ~OccupiedByColor[SideToMove] & ~attackedByThem;
+	Square kingSquare = kingSquares[US];
+	Bitboard kingTargets = KingAttacks[kingSquare] & ~OccupiedByColor[US] & ~attackedByThem;
 	if (CHECKED && kingTargets) {
 		if (popcount(kingTargets) > 2) return true; //unfortunately 8/5p2/5kp1/8/4p3/R4n2/1r3K2/4q3 w - - shows that king itself can even block 2 sliders
 		else {
@@ -424,28 +617,22 @@ template<bool CHECKED> bool Position::CheckValidMoveExists() {
 	}
 	else if (kingTargets) return true; //No need to check
 	if (CHECKED) {
-		Bitboard checker = AttacksOfField(kingSquare, Color(SideToMove ^ 1));
+		Bitboard checker = AttacksOfField(kingSquare, THEM);
 		if (popcount(checker) != 1) return false; //double check and no king move => MATE
 		//All valid moves are now either capturing the checker or blocking the check
 		Bitboard blockingSquares = checker | InBetweenFields[kingSquare][lsb(checker)];
-		Bitboard pinned = checkBlocker(SideToMove, SideToMove);
+		Bitboard pinned = checkBlocker(US, US);
 		//Sliders and knights can't move if pinned (as we are in check) => therefore only check the unpinned pieces
-		Bitboard sliderAndKnight = OccupiedByColor[SideToMove] & ~OccupiedByPieceType[KING] & ~OccupiedByPieceType[PAWN] & ~pinned;
+		Bitboard sliderAndKnight = OccupiedByColor[US] & ~OccupiedByPieceType[KING] & ~OccupiedByPieceType[PAWN] & ~pinned;
 		while (sliderAndKnight) {
-			if (attacks[lsb(sliderAndKnight)] & ~OccupiedByColor[SideToMove] & blockingSquares) return true;
+			if (attacks[lsb(sliderAndKnight)] & ~OccupiedByColor[US] & blockingSquares) return true;
 			sliderAndKnight &= sliderAndKnight - 1;
 		}
 		//Pawns
 		Bitboard singleStepTargets;
-		Bitboard pawns = PieceBB(PAWN, SideToMove) & ~pinned;
-		if (SideToMove == WHITE) {
-			if ((singleStepTargets = ((pawns << 8) & ~OccupiedBB())) & blockingSquares) return true;
-			if (((singleStepTargets & RANK3) << 8) & ~OccupiedBB() & blockingSquares) return true;
-		}
-		else {
-			if ((singleStepTargets = ((pawns >> 8) & ~OccupiedBB())) & blockingSquares) return true;
-			if (((singleStepTargets&RANK6) >> 8) & ~OccupiedBB() & blockingSquares) return true;
-		}
+		Bitboard pawns = PieceBB(PAWN, US) & ~pinned;
+		if ((singleStepTargets = (PawnPush<US>(pawns) & ~OccupiedBB())) & blockingSquares) return true;
+		if (PawnPush<US>(singleStepTargets & (US == WHITE ? RANK3 : RANK6)) & ~OccupiedBB() & blockingSquares) return true;
 		//Pawn captures
 		while (pawns) {
 			Square from = lsb(pawns);
@@ -455,41 +642,39 @@ template<bool CHECKED> bool Position::CheckValidMoveExists() {
 	}
 	else {
 		//Now we need the pinned pieces
-		Bitboard pinned = checkBlocker(SideToMove, SideToMove);
+		Bitboard pinned = checkBlocker(US, US);
 		//Now first check all unpinned pieces
-		Bitboard sliderAndKnight = OccupiedByColor[SideToMove] & ~OccupiedByPieceType[KING] & ~OccupiedByPieceType[PAWN] & ~pinned;
+		Bitboard sliderAndKnight = OccupiedByColor[US] & ~OccupiedByPieceType[KING] & ~OccupiedByPieceType[PAWN] & ~pinned;
 		while (sliderAndKnight) {
-			if (attacks[lsb(sliderAndKnight)] & ~OccupiedByColor[SideToMove]) return true;
+			if (attacks[lsb(sliderAndKnight)] & ~OccupiedByColor[US]) return true;
 			sliderAndKnight &= sliderAndKnight - 1;
 		}
 		//Pawns
-		Bitboard pawns = PieceBB(PAWN, SideToMove) & ~pinned;
+		Bitboard pawns = PieceBB(PAWN, US) & ~pinned;
 		Bitboard pawnTargets;
 		//normal pawn move
-		if (SideToMove == WHITE) pawnTargets = (pawns << 8) & ~OccupiedBB(); else pawnTargets = (pawns >> 8) & ~OccupiedBB();
+		pawnTargets = PawnPush<US>(pawns) & ~OccupiedBB();
 		if (pawnTargets) return true;
 		//pawn capture
-		if (SideToMove == WHITE) pawnTargets = (((pawns << 9) & NOT_A_FILE) | ((pawns << 7) & NOT_H_FILE)) & OccupiedByColor[SideToMove ^ 1];
-		else pawnTargets = (((pawns >> 9) & NOT_H_FILE) | ((pawns >> 7) & NOT_A_FILE)) & OccupiedByColor[SideToMove ^ 1];
+		pawnTargets = PawnTargets<US>(pawns) & OccupiedByColor[THEM];
 		if (pawnTargets) return true;
 		//Now let's deal with pinned pieces
-		Bitboard pinnedSlider = (PieceBB(QUEEN, SideToMove) | PieceBB(ROOK, SideToMove) | PieceBB(BISHOP, SideToMove)) & pinned;
+		Bitboard pinnedSlider = (PieceBB(QUEEN, US) | PieceBB(ROOK, US) | PieceBB(BISHOP, US)) & pinned;
 		while (pinnedSlider) {
 			Square from = lsb(pinnedSlider);
 			if (attacks[from] & (InBetweenFields[from][kingSquare] | ShadowedFields[kingSquare][from])) return true;
 			pinnedSlider &= pinnedSlider - 1;
 		}
 		//pinned knights must not move and pinned kings don't exist => remains pinned pawns
-		Bitboard pinnedPawns = PieceBB(PAWN, SideToMove) & pinned;
+		Bitboard pinnedPawns = PieceBB(PAWN, US) & pinned;
 		Bitboard pinnedPawnsAllowedToMove = pinnedPawns & FILES[kingSquare & 7];
 		if (pinnedPawnsAllowedToMove) {
-			if (SideToMove == WHITE && ((pinnedPawnsAllowedToMove << 8) & ~OccupiedBB())) return true;
-			else if (SideToMove == BLACK && ((pinnedPawnsAllowedToMove >> 8) & ~OccupiedBB())) return true;
+			if (PawnPush<US>(pinnedPawnsAllowedToMove) & ~OccupiedBB()) return true;
 		}
 		//Now there remains only pinned pawn captures
 		while (pinnedPawns) {
 			Square from = lsb(pinnedPawns);
-			pawnTargets = ColorBB(SideToMove ^ 1) & attacks[from];
+			pawnTargets = ColorBB(THEM) & attacks[from];
 			while (pawnTargets) {
 				if (isolateLSB(pawnTargets) & (InBetweenFields[from][kingSquare] | ShadowedFields[kingSquare][from])) return true;
 				pawnTargets &= pawnTargets - 1;
@@ -499,7 +684,7 @@ template<bool CHECKED> bool Position::CheckValidMoveExists() {
 	}
 	//ep-captures are difficult as 3 squares are involved => therefore simply apply and check it
 	Bitboard epAttacker;
-	if (EPSquare != OUTSIDE && (epAttacker = (GetEPAttackersForToField(EPSquare - PawnStep()) & PieceBB(PAWN, SideToMove)))) {
+	if (EPSquare != OUTSIDE && (epAttacker = (GetEPAttackersForToField(EPSquare - pawnStep) & PieceBB(PAWN, US)))) {
 		while (epAttacker) {
 			if (isValid(createMove<ENPASSANT>(lsb(epAttacker), EPSquare))) return true;
 			epAttacker &= epAttacker - 1;
@@ -513,28 +698,35 @@ template<bool CHECKED> bool Position::CheckValidMoveExists() {
 //Should only be used at the root as implementation is slow!
 template<> ValuatedMove* Position::GenerateMoves<LEGAL>() {
 	GenerateMoves<ALL>();
-	for (int i = 0; i < movepointer - 1; ++i) {
-		if (!isValid(moves[i].move)) {
-			moves[i] = moves[movepointer - 2];
-			--movepointer;
+	for (int i = 0; i < moveList->movepointer - 1; ++i) {
+		if (!isValid(moveList->moves[i].move)) {
+			moveList->moves[i] = moveList->moves[moveList->movepointer - 2];
+			--moveList->movepointer;
 			--i;
 		}
 	}
-	return &moves[0];
+	return &moveList->moves[0];
 }
 
 //Generates all quiet moves giving check
 template<> ValuatedMove* Position::GenerateMoves<QUIET_CHECKS>() {
-	movepointer -= (movepointer != 0);
-	ValuatedMove * firstMove = &moves[movepointer];
+	return SideToMove == WHITE ? generateQuietChecks<WHITE>() : generateQuietChecks<BLACK>();
+}
+
+template<Color US> ValuatedMove* Position::generateQuietChecks() {
+	const Color THEM = Color(US ^ 1);
+	const int pawnStep = US == WHITE ? 8 : -8;
+	UpdateAttacks();
+	moveList->movepointer -= (moveList->movepointer != 0);
+	ValuatedMove * firstMove = &moveList->moves[moveList->movepointer];
 	//There are 2 options to give check: Either give check with the moving piece, or a discovered check by
 	//moving a check blocking piece
-	Square opposedKingSquare = kingSquares[SideToMove ^ 1];
+	Square opposedKingSquare = kingSquares[THEM];
 	//1. Discovered Checks
-	Bitboard discoveredCheckCandidates = checkBlocker(SideToMove, Color(SideToMove ^ 1));
+	Bitboard discoveredCheckCandidates = checkBlocker(US, THEM);
 	Bitboard targets = ~OccupiedBB();
 	//1a Sliders
-	Bitboard sliders = (PieceBB(ROOK, SideToMove) | PieceBB(QUEEN, SideToMove) | PieceBB(BISHOP, SideToMove)) & discoveredCheckCandidates;
+	Bitboard sliders = (PieceBB(ROOK, US) | PieceBB(QUEEN, US) | PieceBB(BISHOP, US)) & discoveredCheckCandidates;
 	while (sliders) {
 		Square from = lsb(sliders);
 		Bitboard sliderTargets = attacks[from] & targets & (~InBetweenFields[opposedKingSquare][from] & ~ShadowedFields[opposedKingSquare][from]);
@@ -545,7 +737,7 @@ template<> ValuatedMove* Position::GenerateMoves<QUIET_CHECKS>() {
 		sliders &= sliders - 1;
 	}
 	//1b Knights
-	Bitboard knights = PieceBB(KNIGHT, SideToMove) & discoveredCheckCandidates;
+	Bitboard knights = PieceBB(KNIGHT, US) & discoveredCheckCandidates;
 	while (knights) {
 		Square from = lsb(knights);
 		Bitboard knightTargets = KnightAttacks[from] & targets;
@@ -556,8 +748,8 @@ template<> ValuatedMove* Position::GenerateMoves<QUIET_CHECKS>() {
 		knights &= knights - 1;
 	}
 	//1c Kings
-	Square kingSquare = kingSquares[SideToMove];
-	if (discoveredCheckCandidates & PieceBB(KING, SideToMove)) {
+	Square kingSquare = kingSquares[US];
+	if (discoveredCheckCandidates & PieceBB(KING, US)) {
 		Bitboard kingTargets = KingAttacks[kingSquare] & ~attackedByThem & targets & (~InBetweenFields[opposedKingSquare][kingSquare] & ~ShadowedFields[opposedKingSquare][kingSquare]);
 		while (kingTargets) {
 			AddMove(createMove(kingSquare, lsb(kingTargets)));
@@ -565,28 +757,22 @@ template<> ValuatedMove* Position::GenerateMoves<QUIET_CHECKS>() {
 		}
 	}
 	//1d Pawns
-	Bitboard pawns = PieceBB(PAWN, SideToMove) & discoveredCheckCandidates;
+	Bitboard pawns = PieceBB(PAWN, US) & discoveredCheckCandidates;
 	if (pawns) {
 		Bitboard singleStepTargets;
 		Bitboard doubleStepTargets;
-		if (SideToMove == WHITE) {
-			singleStepTargets = (pawns << 8) & ~RANK8 & targets;
-			doubleStepTargets = ((singleStepTargets & RANK3) << 8) & targets;
-		}
-		else {
-			singleStepTargets = (pawns >> 8) & ~RANK1 & targets;
-			doubleStepTargets = ((singleStepTargets & RANK6) >> 8) & targets;
-		}
+		singleStepTargets = PawnPush<US>(pawns) & ~RANK1and8 & targets;
+		doubleStepTargets = PawnPush<US>(singleStepTargets & (US == WHITE ? RANK3 : RANK6)) & targets;
 		while (singleStepTargets) {
 			Square to = lsb(singleStepTargets);
-			Square from = Square(to - PawnStep());
+			Square from = Square(to - pawnStep);
 			Bitboard stillBlocking = InBetweenFields[from][opposedKingSquare] | ShadowedFields[opposedKingSquare][from];
 			if (!(stillBlocking & ToBitboard(to))) AddMove(createMove(from, to));
 			singleStepTargets &= singleStepTargets - 1;
 		}
 		while (doubleStepTargets) {
 			Square to = lsb(doubleStepTargets);
-			Square from = Square(to - 2 * PawnStep());
+			Square from = Square(to - 2 * pawnStep);
 			Bitboard stillBlocking = InBetweenFields[from][opposedKingSquare] | ShadowedFields[opposedKingSquare][from];
 			if (!(stillBlocking & ToBitboard(to))) AddMove(createMove(from, to));
 			doubleStepTargets &= doubleStepTargets - 1;
@@ -595,7 +781,7 @@ template<> ValuatedMove* Position::GenerateMoves<QUIET_CHECKS>() {
 	//2. Normal checks
 	//2a "Rooks"
 	Bitboard rookAttackstoKing = RookTargets(opposedKingSquare, OccupiedBB()) & targets;
-	Bitboard rooks = (PieceBB(ROOK, SideToMove) | PieceBB(QUEEN, SideToMove)) & ~discoveredCheckCandidates;
+	Bitboard rooks = (PieceBB(ROOK, US) | PieceBB(QUEEN, US)) & ~discoveredCheckCandidates;
 	while (rooks) {
 		Square from = lsb(rooks);
 		Bitboard rookTargets = attacks[from] & rookAttackstoKing;
@@ -607,7 +793,7 @@ template<> ValuatedMove* Position::GenerateMoves<QUIET_CHECKS>() {
 	}
 	//2b "Bishops"
 	Bitboard bishopAttackstoKing = BishopTargets(opposedKingSquare, OccupiedBB()) & targets;
-	Bitboard bishops = (PieceBB(BISHOP, SideToMove) | PieceBB(QUEEN, SideToMove)) & ~discoveredCheckCandidates;
+	Bitboard bishops = (PieceBB(BISHOP, US) | PieceBB(QUEEN, US)) & ~discoveredCheckCandidates;
 	while (bishops) {
 		Square from = lsb(bishops);
 		Bitboard bishopTargets = attacks[from] & bishopAttackstoKing;
@@ -619,7 +805,7 @@ template<> ValuatedMove* Position::GenerateMoves<QUIET_CHECKS>() {
 	}
 	//2c Knights
 	Bitboard knightAttacksToKing = KnightAttacks[opposedKingSquare];
-	knights = PieceBB(KNIGHT, SideToMove) & ~discoveredCheckCandidates;
+	knights = PieceBB(KNIGHT, US) & ~discoveredCheckCandidates;
 	while (knights) {
 		Square from = lsb(knights);
 		Bitboard knightTargets = KnightAttacks[from] & knightAttacksToKing & targets;
@@ -633,48 +819,41 @@ template<> ValuatedMove* Position::GenerateMoves<QUIET_CHECKS>() {
 	Bitboard pawnTargets;
 	Bitboard pawnFrom;
 	Bitboard dblPawnFrom;
-	if (SideToMove == WHITE) {
-		pawnTargets = targets & (((PieceBB(KING, Color(SideToMove ^ 1)) >> 9) & NOT_H_FILE) | ((PieceBB(KING, Color(SideToMove ^ 1)) >> 7) & NOT_A_FILE));
-		pawnFrom = pawnTargets >> 8;
-		dblPawnFrom = ((pawnFrom & targets & RANK3) >> 8) & PieceBB(PAWN, WHITE);
-		pawnFrom &= PieceBB(PAWN, WHITE);
-	}
-	else {
-		pawnTargets = targets & (((PieceBB(KING, Color(SideToMove ^ 1)) << 7) & NOT_H_FILE) | ((PieceBB(KING, Color(SideToMove ^ 1)) << 9) & NOT_A_FILE));
-		pawnFrom = pawnTargets << 8;
-		dblPawnFrom = ((pawnFrom & targets & RANK6) << 8) & PieceBB(PAWN, BLACK);
-		pawnFrom &= PieceBB(PAWN, BLACK);
-	}
+	//Squares from which a pawn of US attacks the opposed king are those attacked by a pawn of THEM from the king square
+	pawnTargets = targets & PawnTargets<THEM>(PieceBB(KING, THEM));
+	pawnFrom = PawnPush<THEM>(pawnTargets);
+	dblPawnFrom = PawnPush<THEM>(pawnFrom & targets & (US == WHITE ? RANK3 : RANK6)) & PieceBB(PAWN, US);
+	pawnFrom &= PieceBB(PAWN, US);
 	while (pawnFrom) {
 		Square from = lsb(pawnFrom);
-		AddMove(createMove(from, from + PawnStep()));
+		AddMove(createMove(from, from + pawnStep));
 		pawnFrom &= pawnFrom - 1;
 	}
 	while (dblPawnFrom) {
 		Square from = lsb(dblPawnFrom);
-		AddMove(createMove(from, from + 2 * PawnStep()));
+		AddMove(createMove(from, from + 2 * pawnStep));
 		dblPawnFrom &= dblPawnFrom - 1;
 	}
 	//2e Castles
-	if (CastlingOptions & 15 & CastlesbyColor[SideToMove]) //King is on initial square
+	if (CastlingOptions & 15 & CastlesbyColor[US]) //King is on initial square
 	{
 		//King-side castles
-		if ((CastlingOptions & 15 & (1 << (2 * SideToMove))) //Short castle allowed
-			&& (InitialRookSquareBB[2 * SideToMove] & PieceBB(ROOK, SideToMove)) //Rook on initial square
-			&& !(SquaresToBeEmpty[2 * SideToMove] & OccupiedBB()) //Fields between Rook and King are empty
-			&& !(SquaresToBeUnattacked[2 * SideToMove] & attackedByThem) //Fields passed by the king are unattacked
-			&& (RookTargets(opposedKingSquare, ~targets & ~PieceBB(KING, SideToMove)) & RookSquareAfterCastling[2 * SideToMove])) //Rook is giving check after castling
+		if ((CastlingOptions & 15 & (1 << (2 * US))) //Short castle allowed
+			&& (InitialRookSquareBB[2 * US] & PieceBB(ROOK, US)) //Rook on initial square
+			&& !(SquaresToBeEmpty[2 * US] & OccupiedBB()) //Fields between Rook and King are empty
+			&& !(SquaresToBeUnattacked[2 * US] & attackedByThem) //Fields passed by the king are unattacked
+			&& (RookTargets(opposedKingSquare, ~targets & ~PieceBB(KING, US)) & RookSquareAfterCastling[2 * US])) //Rook is giving check after castling
 		{
-			if (Chess960) AddMove(createMove<CASTLING>(kingSquare, InitialRookSquare[2 * SideToMove])); else AddMove(createMove<CASTLING>(kingSquare, Square(G1 + SideToMove * 56)));
+			if (Chess960) AddMove(createMove<CASTLING>(kingSquare, InitialRookSquare[2 * US])); else AddMove(createMove<CASTLING>(kingSquare, RelativeSquare<US>(G1)));
 		}
 		//Queen-side castles
-		if ((CastlingOptions & 15 & (1 << (2 * SideToMove + 1))) //Short castle allowed
-			&& (InitialRookSquareBB[2 * SideToMove + 1] & PieceBB(ROOK, SideToMove)) //Rook on initial square
-			&& !(SquaresToBeEmpty[2 * SideToMove + 1] & OccupiedBB()) //Fields between Rook and King are empty
-			&& !(SquaresToBeUnattacked[2 * SideToMove + 1] & attackedByThem) //Fields passed by the king are unattacked
-			&& (RookTargets(opposedKingSquare, ~targets & ~PieceBB(KING, SideToMove)) & RookSquareAfterCastling[2 * SideToMove + 1])) //Rook is giving check after castling
+		if ((CastlingOptions & 15 & (1 << (2 * US + 1))) //Short castle allowed
+			&& (InitialRookSquareBB[2 * US + 1] & PieceBB(ROOK, US)) //Rook on initial square
+			&& !(SquaresToBeEmpty[2 * US + 1] & OccupiedBB()) //Fields between Rook and King are empty
+			&& !(SquaresToBeUnattacked[2 * US + 1] & attackedByThem) //Fields passed by the king are unattacked
+			&& (RookTargets(opposedKingSquare, ~targets & ~PieceBB(KING, US)) & RookSquareAfterCastling[2 * US + 1])) //Rook is giving check after castling
 		{
-			if (Chess960) AddMove(createMove<CASTLING>(kingSquare, InitialRookSquare[2 * SideToMove + 1])); else AddMove(createMove<CASTLING>(kingSquare, Square(C1 + SideToMove * 56)));
+			if (Chess960) AddMove(createMove<CASTLING>(kingSquare, InitialRookSquare[2 * US + 1])); else AddMove(createMove<CASTLING>(kingSquare, RelativeSquare<US>(C1)));
 		}
 	}
 	AddNullMove();
@@ -689,61 +868,70 @@ template<> inline ValuatedMove* Position::GenerateMoves<FORKS_NO_CHECKS>() {
 	return GenerateForks(false);
 }
 
-template<MoveGenerationType MGT> ValuatedMove * Position::GenerateMoves() {
-	if (MGT == ALL || MGT == CHECK_EVASION) movepointer = 0; else movepointer -= (movepointer != 0);
-	ValuatedMove * firstMove = &moves[movepointer];
+template<MoveGenerationType MGT> inline ValuatedMove * Position::GenerateMoves() {
+	return SideToMove == WHITE ? generateMoves<MGT, WHITE>() : generateMoves<MGT, BLACK>();
+}
+
+template<MoveGenerationType MGT, Color US> ValuatedMove * Position::generateMoves() {
+	const Color THEM = Color(US ^ 1);
+	const int pawnStep = US == WHITE ? 8 : -8;
+	const Bitboard promotionRank = US == WHITE ? RANK8 : RANK1;
+	const Bitboard doubleStepRank = US == WHITE ? RANK3 : RANK6;
+	UpdateAttacks();
+	if (MGT == ALL || MGT == CHECK_EVASION) moveList->movepointer = 0; else moveList->movepointer -= (moveList->movepointer != 0);
+	ValuatedMove * firstMove = &moveList->moves[moveList->movepointer];
 	//Rooksliders
 	Bitboard targets;
 	if (MGT == ALL || MGT == TACTICAL || MGT == QUIETS || MGT == CHECK_EVASION) {
-		Square kingSquare = kingSquares[SideToMove];
+		Square kingSquare = kingSquares[US];
 		Bitboard checkBlocker = 0;
 		bool doubleCheck = false;
 		if (MGT == CHECK_EVASION) {
-			Bitboard checker = AttacksOfField(kingSquare, Color(SideToMove ^ 1));
+			Bitboard checker = AttacksOfField(kingSquare, THEM);
 			if (popcount(checker) == 1) {
 				checkBlocker = checker | InBetweenFields[kingSquare][lsb(checker)];
 			}
 			else doubleCheck = true;
 		}
 		Bitboard empty = ~ColorBB(BLACK) & ~ColorBB(WHITE);
-		if (MGT == ALL) targets = ~ColorBB(SideToMove);
-		else if (MGT == TACTICAL) targets = ColorBB(SideToMove ^ 1);
+		if (MGT == ALL) targets = ~ColorBB(US);
+		else if (MGT == TACTICAL) targets = ColorBB(THEM);
 		else if (MGT == QUIETS) targets = empty;
-		else if (MGT == CHECK_EVASION && !doubleCheck) targets = ~ColorBB(SideToMove) & checkBlocker;
+		else if (MGT == CHECK_EVASION && !doubleCheck) targets = ~ColorBB(US) & checkBlocker;
 		else targets = 0;
 		//Kings
 		Bitboard kingTargets;
-		if (MGT == CHECK_EVASION) kingTargets = KingAttacks[kingSquare] & ~OccupiedByColor[SideToMove] & ~attackedByThem;
+		if (MGT == CHECK_EVASION) kingTargets = KingAttacks[kingSquare] & ~OccupiedByColor[US] & ~attackedByThem;
 		else kingTargets = KingAttacks[kingSquare] & targets & ~attackedByThem;
 		while (kingTargets) {
 			AddMove(createMove(kingSquare, lsb(kingTargets)));
 			kingTargets &= kingTargets - 1;
 		}
 		if (MGT == ALL || MGT == QUIETS) {
-			if (CastlingOptions & 15 & CastlesbyColor[SideToMove]) //King is on initial square
+			if (CastlingOptions & 15 & CastlesbyColor[US]) //King is on initial square
 			{
 				//King-side castles
-				if ((CastlingOptions & 15 & (1 << (2 * SideToMove))) //Short castle allowed
-					&& (InitialRookSquareBB[2 * SideToMove] & PieceBB(PieceType::ROOK, SideToMove)) //Rook on initial square
-					&& !(SquaresToBeEmpty[2 * SideToMove] & OccupiedBB()) //Fields between Rook and King are empty
-					&& !(SquaresToBeUnattacked[2 * SideToMove] & attackedByThem)) //Fields passed by the king are unattacked
+				if ((CastlingOptions & 15 & (1 << (2 * US))) //Short castle allowed
+					&& (InitialRookSquareBB[2 * US] & PieceBB(PieceType::ROOK, US)) //Rook on initial square
+					&& !(SquaresToBeEmpty[2 * US] & OccupiedBB()) //Fields between Rook and King are empty
+					&& !(SquaresToBeUnattacked[2 * US] & attackedByThem)) //Fields passed by the king are unattacked
 				{
-					if (Chess960) AddMove(createMove<CASTLING>(kingSquare, InitialRookSquare[2 * SideToMove]));
-					else AddMove(createMove<CASTLING>(kingSquare, Square(G1 + SideToMove * 56)));
+					if (Chess960) AddMove(createMove<CASTLING>(kingSquare, InitialRookSquare[2 * US]));
+					else AddMove(createMove<CASTLING>(kingSquare, RelativeSquare<US>(G1)));
 				}
 				//Queen-side castles
-				if ((CastlingOptions & 15 & (1 << (2 * SideToMove + 1))) //Short castle allowed
-					&& (InitialRookSquareBB[2 * SideToMove + 1] & PieceBB(ROOK, SideToMove)) //Rook on initial square
-					&& !(SquaresToBeEmpty[2 * SideToMove + 1] & OccupiedBB()) //Fields between Rook and King are empty
-					&& !(SquaresToBeUnattacked[2 * SideToMove + 1] & attackedByThem)) //Fields passed by the king are unattacked
+				if ((CastlingOptions & 15 & (1 << (2 * US + 1))) //Short castle allowed
+					&& (InitialRookSquareBB[2 * US + 1] & PieceBB(ROOK, US)) //Rook on initial square
+					&& !(SquaresToBeEmpty[2 * US + 1] & OccupiedBB()) //Fields between Rook and King are empty
+					&& !(SquaresToBeUnattacked[2 * US + 1] & attackedByThem)) //Fields passed by the king are unattacked
 				{
-					if (Chess960) AddMove(createMove<CASTLING>(kingSquare, InitialRookSquare[2 * SideToMove + 1]));
-					else AddMove(createMove<CASTLING>(kingSquare, Square(C1 + SideToMove * 56)));
+					if (Chess960) AddMove(createMove<CASTLING>(kingSquare, InitialRookSquare[2 * US + 1]));
+					else AddMove(createMove<CASTLING>(kingSquare, RelativeSquare<US>(C1)));
 				}
 			}
 		}
 		if (!doubleCheck) {
-			Bitboard sliders = PieceBB(PieceType::ROOK, SideToMove) | PieceBB(PieceType::QUEEN, SideToMove) | PieceBB(PieceType::BISHOP, SideToMove);
+			Bitboard sliders = PieceBB(PieceType::ROOK, US) | PieceBB(PieceType::QUEEN, US) | PieceBB(PieceType::BISHOP, US);
 			while (sliders) {
 				Square from = lsb(sliders);
 				Bitboard sliderTargets = attacks[from] & targets;
@@ -754,7 +942,7 @@ template<MoveGenerationType MGT> ValuatedMove * Position::GenerateMoves() {
 				sliders &= sliders - 1;
 			}
 			//Knights
-			Bitboard knights = PieceBB(KNIGHT, SideToMove);
+			Bitboard knights = PieceBB(KNIGHT, US);
 			while (knights) {
 				Square from = lsb(knights);
 				Bitboard knightTargets;
@@ -766,23 +954,23 @@ template<MoveGenerationType MGT> ValuatedMove * Position::GenerateMoves() {
 				knights &= knights - 1;
 			}
 			//Pawns
-			Bitboard pawns = PieceBB(PAWN, SideToMove);
+			Bitboard pawns = PieceBB(PAWN, US);
 			//Captures
 			if (MGT == ALL || MGT == TACTICAL || MGT == CHECK_EVASION) {
 				while (pawns) {
 					Square from = lsb(pawns);
 					Bitboard pawnTargets;
-					if (MGT == CHECK_EVASION) pawnTargets = ColorBB(SideToMove ^ 1) & attacks[from] & ~RANK1and8 & checkBlocker; else pawnTargets = ColorBB(SideToMove ^ 1) & attacks[from] & ~RANK1and8;
+					if (MGT == CHECK_EVASION) pawnTargets = ColorBB(THEM) & attacks[from] & ~RANK1and8 & checkBlocker; else pawnTargets = ColorBB(THEM) & attacks[from] & ~RANK1and8;
 					while (pawnTargets) {
 						AddMove(createMove(from, lsb(pawnTargets)));
 						pawnTargets &= pawnTargets - 1;
 					}
 					//Promotion Captures
-					if (MGT == CHECK_EVASION) pawnTargets = ColorBB(SideToMove ^ 1) & attacks[from] & RANK1and8 & checkBlocker; else pawnTargets = ColorBB(SideToMove ^ 1) & attacks[from] & RANK1and8;
+					if (MGT == CHECK_EVASION) pawnTargets = ColorBB(THEM) & attacks[from] & RANK1and8 & checkBlocker; else pawnTargets = ColorBB(THEM) & attacks[from] & RANK1and8;
 					while (pawnTargets) {
 						Square to = lsb(pawnTargets);
 						AddMove(createMove<PROMOTION>(from, to, QUEEN));
-						canPromote = true;
+						moveList->canPromote = true;
 						pawnTargets &= pawnTargets - 1;
 					}
 					pawns &= pawns - 1;
@@ -791,41 +979,27 @@ template<MoveGenerationType MGT> ValuatedMove * Position::GenerateMoves() {
 			Bitboard singleStepTarget = 0;
 			Bitboard doubleSteptarget = 0;
 			Bitboard promotionTarget = 0;
-			if (SideToMove == WHITE) {
-				if (MGT == ALL || MGT == QUIETS) {
-					singleStepTarget = (PieceBB(PAWN, WHITE) << 8) & empty & ~RANK8;
-					doubleSteptarget = ((singleStepTarget & RANK3) << 8) & empty;
-				}
-				else if (MGT == CHECK_EVASION) {
-					singleStepTarget = (PieceBB(PAWN, WHITE) << 8) & empty & ~RANK8;
-					doubleSteptarget = ((singleStepTarget & RANK3) << 8) & empty & checkBlocker;
-					singleStepTarget &= checkBlocker;
-				}
-				if (MGT == ALL || MGT == TACTICAL) promotionTarget = (PieceBB(PAWN, WHITE) << 8) & empty & RANK8;
-				else if (MGT == CHECK_EVASION) promotionTarget = (PieceBB(PAWN, WHITE) << 8) & empty & RANK8 & checkBlocker;
+			const Bitboard pushes = PawnPush<US>(PieceBB(PAWN, US)) & empty;
+			if (MGT == ALL || MGT == QUIETS) {
+				singleStepTarget = pushes & ~promotionRank;
+				doubleSteptarget = PawnPush<US>(singleStepTarget & doubleStepRank) & empty;
 			}
-			else {
-				if (MGT == ALL || MGT == QUIETS) {
-					singleStepTarget = (PieceBB(PAWN, BLACK) >> 8) & empty & ~RANK1;
-					doubleSteptarget = ((singleStepTarget & RANK6) >> 8) & empty;
-				}
-				else if (MGT == CHECK_EVASION) {
-					singleStepTarget = (PieceBB(PAWN, BLACK) >> 8) & empty & ~RANK1;
-					doubleSteptarget = ((singleStepTarget & RANK6) >> 8) & empty & checkBlocker;
-					singleStepTarget &= checkBlocker;
-				}
-				if (MGT == ALL || MGT == TACTICAL) promotionTarget = (PieceBB(PAWN, BLACK) >> 8) & empty & RANK1;
-				else if (MGT == CHECK_EVASION) promotionTarget = (PieceBB(PAWN, BLACK) >> 8) & empty & RANK1 & checkBlocker;
+			else if (MGT == CHECK_EVASION) {
+				singleStepTarget = pushes & ~promotionRank;
+				doubleSteptarget = PawnPush<US>(singleStepTarget & doubleStepRank) & empty & checkBlocker;
+				singleStepTarget &= checkBlocker;
 			}
+			if (MGT == ALL || MGT == TACTICAL) promotionTarget = pushes & promotionRank;
+			else if (MGT == CHECK_EVASION) promotionTarget = pushes & promotionRank & checkBlocker;
 			if (MGT == ALL || MGT == QUIETS || MGT == CHECK_EVASION) {
 				while (singleStepTarget) {
 					Square to = lsb(singleStepTarget);
-					AddMove(createMove(to - PawnStep(), to));
+					AddMove(createMove(to - pawnStep, to));
 					singleStepTarget &= singleStepTarget - 1;
 				}
 				while (doubleSteptarget) {
 					Square to = lsb(doubleSteptarget);
-					AddMove(createMove(to - 2 * PawnStep(), to));
+					AddMove(createMove(to - 2 * pawnStep, to));
 					doubleSteptarget &= doubleSteptarget - 1;
 				}
 			}
@@ -833,13 +1007,13 @@ template<MoveGenerationType MGT> ValuatedMove * Position::GenerateMoves() {
 			if (MGT == ALL || MGT == TACTICAL || MGT == CHECK_EVASION) {
 				while (promotionTarget) {
 					Square to = lsb(promotionTarget);
-					Square from = Square(to - PawnStep());
+					Square from = Square(to - pawnStep);
 					AddMove(createMove<PROMOTION>(from, to, QUEEN));
-					canPromote = true;
+					moveList->canPromote = true;
 					promotionTarget &= promotionTarget - 1;
 				}
 				Bitboard epAttacker;
-				if (EPSquare != OUTSIDE && (epAttacker = (GetEPAttackersForToField(EPSquare - PawnStep()) & PieceBB(PAWN, SideToMove)))) {
+				if (EPSquare != OUTSIDE && (epAttacker = (GetEPAttackersForToField(EPSquare - pawnStep) & PieceBB(PAWN, US)))) {
 					while (epAttacker) {
 						AddMove(createMove<ENPASSANT>(lsb(epAttacker), EPSquare));
 						epAttacker &= epAttacker - 1;
@@ -847,10 +1021,10 @@ template<MoveGenerationType MGT> ValuatedMove * Position::GenerateMoves() {
 				}
 			}
 		}
-		if (MGT == ALL && canPromote) {
-			int moveCount = movepointer;
+		if (MGT == ALL && moveList->canPromote) {
+			int moveCount = moveList->movepointer;
 			for (int i = 0; i < moveCount; ++i) {
-				Move pmove = moves[i].move;
+				Move pmove = moveList->moves[i].move;
 				if (type(pmove) == PROMOTION) {
 					AddMove(createMove<PROMOTION>(from(pmove), to(pmove), KNIGHT));
 					AddMove(createMove<PROMOTION>(from(pmove), to(pmove), ROOK));
@@ -861,20 +1035,19 @@ template<MoveGenerationType MGT> ValuatedMove * Position::GenerateMoves() {
 	}
 	else { //Winning, Equal and loosing captures
 		Bitboard sliders;
-		Bitboard hanging = ColorBB(Color(SideToMove ^ 1)) & ~AttackedByThem();
+		Bitboard hanging = ColorBB(THEM) & ~AttackedByThem();
 		if (MGT == WINNING_CAPTURES || MGT == NON_LOOSING_CAPTURES) {
-			Bitboard promotionTarget;
-			if (SideToMove == WHITE)  promotionTarget = (PieceBB(PAWN, WHITE) << 8) & ~OccupiedBB() & RANK8; else promotionTarget = (PieceBB(PAWN, BLACK) >> 8) & ~OccupiedBB() & RANK1;
+			Bitboard promotionTarget = PawnPush<US>(PieceBB(PAWN, US)) & ~OccupiedBB() & promotionRank;
 			while (promotionTarget) {
 				Square to = lsb(promotionTarget);
-				Square from = Square(to - PawnStep());
+				Square from = Square(to - pawnStep);
 				AddMove(createMove<PROMOTION>(from, to, QUEEN));
-				canPromote = true;
+				moveList->canPromote = true;
 				promotionTarget &= promotionTarget - 1;
 			}
 			//King Captures are always winning as kings can only capture uncovered pieces
-			Square kingSquare = kingSquares[SideToMove];
-			Bitboard kingTargets = KingAttacks[kingSquare] & ColorBB(SideToMove ^ 1) & ~attackedByThem;
+			Square kingSquare = kingSquares[US];
+			Bitboard kingTargets = KingAttacks[kingSquare] & ColorBB(THEM) & ~attackedByThem;
 			while (kingTargets) {
 				AddMove(createMove(kingSquare, lsb(kingTargets)));
 				kingTargets &= kingTargets - 1;
@@ -882,30 +1055,30 @@ template<MoveGenerationType MGT> ValuatedMove * Position::GenerateMoves() {
 		}
 		//Pawn Captures
 		if (MGT == WINNING_CAPTURES) {
-			Bitboard pawns = PieceBB(PAWN, SideToMove);
+			Bitboard pawns = PieceBB(PAWN, US);
 			while (pawns) {
 				Square from = lsb(pawns);
-				Bitboard pawnTargets = ColorBB(SideToMove ^ 1) & (~PieceBB(PAWN, Color(SideToMove ^ 1)) | hanging) & attacks[from] & ~RANK1and8;
+				Bitboard pawnTargets = ColorBB(THEM) & (~PieceBB(PAWN, THEM) | hanging) & attacks[from] & ~RANK1and8;
 				while (pawnTargets) {
 					AddMove(createMove(from, lsb(pawnTargets)));
 					pawnTargets &= pawnTargets - 1;
 				}
 				//Promotion Captures
-				pawnTargets = ColorBB(SideToMove ^ 1) & attacks[from] & RANK1and8;
+				pawnTargets = ColorBB(THEM) & attacks[from] & RANK1and8;
 				while (pawnTargets) {
 					Square to = lsb(pawnTargets);
 					AddMove(createMove<PROMOTION>(from, to, QUEEN));
-					canPromote = true;
+					moveList->canPromote = true;
 					pawnTargets &= pawnTargets - 1;
 				}
 				pawns &= pawns - 1;
 			}
 		}
 		else if (MGT == EQUAL_CAPTURES) {
-			Bitboard pawns = PieceBB(PAWN, SideToMove);
+			Bitboard pawns = PieceBB(PAWN, US);
 			while (pawns) {
 				Square from = lsb(pawns);
-				Bitboard pawnTargets = PieceBB(PAWN, Color(SideToMove ^ 1)) & attacks[from] & ~hanging;
+				Bitboard pawnTargets = PieceBB(PAWN, THEM) & attacks[from] & ~hanging;
 				while (pawnTargets) {
 					AddMove(createMove(from, lsb(pawnTargets)));
 					pawnTargets &= pawnTargets - 1;
@@ -913,7 +1086,7 @@ template<MoveGenerationType MGT> ValuatedMove * Position::GenerateMoves() {
 				pawns &= pawns - 1;
 			}
 			Bitboard epAttacker;
-			if (EPSquare != OUTSIDE && (epAttacker = (GetEPAttackersForToField(EPSquare - PawnStep()) & PieceBB(PAWN, SideToMove)))) {
+			if (EPSquare != OUTSIDE && (epAttacker = (GetEPAttackersForToField(EPSquare - pawnStep) & PieceBB(PAWN, US)))) {
 				while (epAttacker) {
 					AddMove(createMove<ENPASSANT>(lsb(epAttacker), EPSquare));
 					epAttacker &= epAttacker - 1;
@@ -921,26 +1094,26 @@ template<MoveGenerationType MGT> ValuatedMove * Position::GenerateMoves() {
 			}
 		}
 		else if (MGT == NON_LOOSING_CAPTURES) {
-			Bitboard pawns = PieceBB(PAWN, SideToMove);
+			Bitboard pawns = PieceBB(PAWN, US);
 			while (pawns) {
 				Square from = lsb(pawns);
-				Bitboard pawnTargets = ColorBB(SideToMove ^ 1) & attacks[from] & ~RANK1and8;
+				Bitboard pawnTargets = ColorBB(THEM) & attacks[from] & ~RANK1and8;
 				while (pawnTargets) {
 					AddMove(createMove(from, lsb(pawnTargets)));
 					pawnTargets &= pawnTargets - 1;
 				}
 				//Promotion captures
-				pawnTargets = ColorBB(SideToMove ^ 1) & attacks[from] & RANK1and8;
+				pawnTargets = ColorBB(THEM) & attacks[from] & RANK1and8;
 				while (pawnTargets) {
 					Square to = lsb(pawnTargets);
 					AddMove(createMove<PROMOTION>(from, to, QUEEN));
-					canPromote = true;
+					moveList->canPromote = true;
 					pawnTargets &= pawnTargets - 1;
 				}
 				pawns &= pawns - 1;
 			}
 			Bitboard epAttacker;
-			if (EPSquare != OUTSIDE && (epAttacker = (GetEPAttackersForToField(EPSquare - PawnStep()) & PieceBB(PAWN, SideToMove)))) {
+			if (EPSquare != OUTSIDE && (epAttacker = (GetEPAttackersForToField(EPSquare - pawnStep) & PieceBB(PAWN, US)))) {
 				while (epAttacker) {
 					AddMove(createMove<ENPASSANT>(lsb(epAttacker), EPSquare));
 					epAttacker &= epAttacker - 1;
@@ -948,12 +1121,12 @@ template<MoveGenerationType MGT> ValuatedMove * Position::GenerateMoves() {
 			}
 		}
 		//Knight Captures
-		if (MGT == WINNING_CAPTURES) targets = PieceBB(QUEEN, Color(SideToMove ^ 1)) | PieceBB(ROOK, Color(SideToMove ^ 1)) | hanging;
-		else if (MGT == EQUAL_CAPTURES) targets = (PieceBB(BISHOP, Color(SideToMove ^ 1)) | PieceBB(KNIGHT, Color(SideToMove ^ 1))) & ~hanging;
-		else if (MGT == LOOSING_CAPTURES) targets = PieceBB(PAWN, Color(SideToMove ^ 1)) & ~hanging;
-		else if (MGT == NON_LOOSING_CAPTURES) targets = PieceBB(BISHOP, Color(SideToMove ^ 1)) | PieceBB(KNIGHT, Color(SideToMove ^ 1)) | PieceBB(QUEEN, Color(SideToMove ^ 1)) | PieceBB(ROOK, Color(SideToMove ^ 1)) | hanging;
+		if (MGT == WINNING_CAPTURES) targets = PieceBB(QUEEN, THEM) | PieceBB(ROOK, THEM) | hanging;
+		else if (MGT == EQUAL_CAPTURES) targets = (PieceBB(BISHOP, THEM) | PieceBB(KNIGHT, THEM)) & ~hanging;
+		else if (MGT == LOOSING_CAPTURES) targets = PieceBB(PAWN, THEM) & ~hanging;
+		else if (MGT == NON_LOOSING_CAPTURES) targets = PieceBB(BISHOP, THEM) | PieceBB(KNIGHT, THEM) | PieceBB(QUEEN, THEM) | PieceBB(ROOK, THEM) | hanging;
 		else targets = 0;
-		Bitboard knights = PieceBB(KNIGHT, SideToMove);
+		Bitboard knights = PieceBB(KNIGHT, US);
 		while (knights) {
 			Square from = lsb(knights);
 			Bitboard knightTargets = attacks[from] & targets;
@@ -964,11 +1137,11 @@ template<MoveGenerationType MGT> ValuatedMove * Position::GenerateMoves() {
 			knights &= knights - 1;
 		}
 		//Bishop Captures
-		sliders = PieceBB(BISHOP, SideToMove);
-		if (MGT == WINNING_CAPTURES) targets = PieceBB(QUEEN, Color(SideToMove ^ 1)) | PieceBB(ROOK, Color(SideToMove ^ 1)) | hanging;
-		else if (MGT == EQUAL_CAPTURES) targets = (PieceBB(BISHOP, Color(SideToMove ^ 1)) | PieceBB(KNIGHT, Color(SideToMove ^ 1))) & ~hanging;
-		else if (MGT == LOOSING_CAPTURES) targets = PieceBB(PAWN, Color(SideToMove ^ 1)) & ~hanging;
-		else if (MGT == NON_LOOSING_CAPTURES) targets = PieceBB(BISHOP, Color(SideToMove ^ 1)) | PieceBB(KNIGHT, Color(SideToMove ^ 1)) | PieceBB(QUEEN, Color(SideToMove ^ 1)) | PieceBB(ROOK, Color(SideToMove ^ 1)) | hanging;
+		sliders = PieceBB(BISHOP, US);
+		if (MGT == WINNING_CAPTURES) targets = PieceBB(QUEEN, THEM) | PieceBB(ROOK, THEM) | hanging;
+		else if (MGT == EQUAL_CAPTURES) targets = (PieceBB(BISHOP, THEM) | PieceBB(KNIGHT, THEM)) & ~hanging;
+		else if (MGT == LOOSING_CAPTURES) targets = PieceBB(PAWN, THEM) & ~hanging;
+		else if (MGT == NON_LOOSING_CAPTURES) targets = PieceBB(BISHOP, THEM) | PieceBB(KNIGHT, THEM) | PieceBB(QUEEN, THEM) | PieceBB(ROOK, THEM) | hanging;
 		else targets = 0;
 		while (sliders) {
 			Square from = lsb(sliders);
@@ -980,11 +1153,11 @@ template<MoveGenerationType MGT> ValuatedMove * Position::GenerateMoves() {
 			sliders &= sliders - 1;
 		}
 		//Rook Captures
-		sliders = PieceBB(ROOK, SideToMove);
-		if (MGT == WINNING_CAPTURES) targets = PieceBB(QUEEN, Color(SideToMove ^ 1)) | hanging;
-		else if (MGT == EQUAL_CAPTURES) targets = PieceBB(ROOK, Color(SideToMove ^ 1)) & ~hanging;
-		else if (MGT == LOOSING_CAPTURES) targets = (PieceBB(BISHOP, Color(SideToMove ^ 1)) | PieceBB(KNIGHT, Color(SideToMove ^ 1)) | PieceBB(PAWN, Color(SideToMove ^ 1))) & ~hanging;
-		else if (MGT == NON_LOOSING_CAPTURES) targets = PieceBB(QUEEN, Color(SideToMove ^ 1)) | PieceBB(ROOK, Color(SideToMove ^ 1)) | hanging;
+		sliders = PieceBB(ROOK, US);
+		if (MGT == WINNING_CAPTURES) targets = PieceBB(QUEEN, THEM) | hanging;
+		else if (MGT == EQUAL_CAPTURES) targets = PieceBB(ROOK, THEM) & ~hanging;
+		else if (MGT == LOOSING_CAPTURES) targets = (PieceBB(BISHOP, THEM) | PieceBB(KNIGHT, THEM) | PieceBB(PAWN, THEM)) & ~hanging;
+		else if (MGT == NON_LOOSING_CAPTURES) targets = PieceBB(QUEEN, THEM) | PieceBB(ROOK, THEM) | hanging;
 		else targets = 0;
 		while (sliders) {
 			Square from = lsb(sliders);
@@ -996,11 +1169,11 @@ template<MoveGenerationType MGT> ValuatedMove * Position::GenerateMoves() {
 			sliders &= sliders - 1;
 		}
 		//Queen Captures
-		sliders = PieceBB(QUEEN, SideToMove);
+		sliders = PieceBB(QUEEN, US);
 		if (MGT == WINNING_CAPTURES) targets = hanging;
-		if (MGT == EQUAL_CAPTURES) targets = PieceBB(QUEEN, Color(SideToMove ^ 1)) & ~hanging;
-		else if (MGT == NON_LOOSING_CAPTURES) targets = PieceBB(QUEEN, Color(SideToMove ^ 1)) | hanging;
-		else if (MGT == LOOSING_CAPTURES) targets = (PieceBB(ROOK, Color(SideToMove ^ 1)) | PieceBB(BISHOP, Color(SideToMove ^ 1)) | PieceBB(KNIGHT, Color(SideToMove ^ 1)) | PieceBB(PAWN, Color(SideToMove ^ 1))) & ~hanging;
+		if (MGT == EQUAL_CAPTURES) targets = PieceBB(QUEEN, THEM) & ~hanging;
+		else if (MGT == NON_LOOSING_CAPTURES) targets = PieceBB(QUEEN, THEM) | hanging;
+		else if (MGT == LOOSING_CAPTURES) targets = (PieceBB(ROOK, THEM) | PieceBB(BISHOP, THEM) | PieceBB(KNIGHT, THEM) | PieceBB(PAWN, THEM)) & ~hanging;
 		else targets = 0;
 		while (sliders) {
 			Square from = lsb(sliders);
@@ -1018,31 +1191,32 @@ template<MoveGenerationType MGT> ValuatedMove * Position::GenerateMoves() {
 
 
 template<StagedMoveGenerationType SMGT> void Position::InitializeMoveIterator(HistoryManager * historyStats, MoveSequenceHistoryManager * counterHistoryStats, MoveSequenceHistoryManager * followupHistoryStats, killer::Manager * km, Move counter, Move hashmove) {
-	processedMoveGenerationPhases = 0;
+	moveList->processedMoveGenerationPhases = 0;
 	if (SMGT == REPETITION) {
-		moveIterationPointer = 0;
-		generationPhase = generationPhaseOffset[SMGT];
+		moveList->moveIterationPointer = 0;
+		moveList->generationPhase = generationPhaseOffset[SMGT];
 		return;
 	}
 	if (SMGT == ALL_MOVES) {
-		moveIterationPointer = -1;
-		generationPhase = generationPhaseOffset[SMGT];
+		moveList->moveIterationPointer = -1;
+		moveList->generationPhase = generationPhaseOffset[SMGT];
 		return;
 	}
-	if (SMGT == MAIN_SEARCH) killerManager = km; else killerManager = nullptr;
-	counterMove = counter;
-	moveIterationPointer = -1;
-	movepointer = 0;
-	phaseStartIndex = 0;
-	history = historyStats;
-	cmHistory = counterHistoryStats;
-	followupHistory = followupHistoryStats;
-	hashMove = hashmove;
-	if (Checked()) generationPhase = generationPhaseOffset[CHECK] + (hashMove == MOVE_NONE);
-	else generationPhase = generationPhaseOffset[SMGT] + (hashMove == MOVE_NONE);
+	if (SMGT == MAIN_SEARCH) moveList->killerManager = km; else moveList->killerManager = nullptr;
+	moveList->counterMove = counter;
+	moveList->moveIterationPointer = -1;
+	moveList->movepointer = 0;
+	moveList->phaseStartIndex = 0;
+	moveList->history = historyStats;
+	moveList->cmHistory = counterHistoryStats;
+	moveList->followupHistory = followupHistoryStats;
+	moveList->hashMove = hashmove;
+	if (Checked()) moveList->generationPhase = generationPhaseOffset[CHECK] + (moveList->hashMove == MOVE_NONE);
+	else moveList->generationPhase = generationPhaseOffset[SMGT] + (moveList->hashMove == MOVE_NONE);
 }
 
 inline Bitboard Position::AttacksByPieceType(Color color, PieceType pieceType) const {
+	UpdateAttacks();
 	return attacksByPt[GetPiece(pieceType, color)];
 }
 
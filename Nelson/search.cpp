@@ -6,35 +6,100 @@
 #include <cstring>
 #include <thread>
 #include <chrono>
+#include <new>
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
 #include "search.h"
 #include "hashtables.h"
 #include "evaluation.h"
 #include "tbprobe.h"
 
+void SearchCounters::reset() {
+	nodes.store(0, std::memory_order_relaxed);
+	qnodes.store(0, std::memory_order_relaxed);
+	tbHits.store(0, std::memory_order_relaxed);
+}
+
+//Allocates the counters of all threads, so that each thread's counters start at a cache line boundary
+static SearchCounters * allocateCounters() {
+	void * mem = nullptr;
+#ifdef _MSC_VER
+	mem = _aligned_malloc(MAX_THREADS * sizeof(SearchCounters), alignof(SearchCounters));
+#else
+	if (posix_memalign(&mem, alignof(SearchCounters), MAX_THREADS * sizeof(SearchCounters)) != 0) mem = nullptr;
+#endif
+	if (mem == nullptr) throw std::bad_alloc();
+	SearchCounters * counters = static_cast<SearchCounters *>(mem);
+	for (int i = 0; i < MAX_THREADS; ++i) new (&counters[i]) SearchCounters();
+	return counters;
+}
+
+static void freeCounters(SearchCounters * counters) {
+	for (int i = 0; i < MAX_THREADS; ++i) counters[i].~SearchCounters();
+#ifdef _MSC_VER
+	_aligned_free(counters);
+#else
+	free(counters);
+#endif
+}
+
+int64_t Search::NodeCount() const {
+	int64_t result = 0;
+	for (int i = 0; i < threadCount(); ++i) result += counters[i].nodes.load(std::memory_order_relaxed);
+	return result;
+}
+
+int64_t Search::QNodeCount() const {
+	int64_t result = 0;
+	for (int i = 0; i < threadCount(); ++i) result += counters[i].qnodes.load(std::memory_order_relaxed);
+	return result;
+}
+
+int64_t Search::TbHits() const {
+	int64_t result = 0;
+	for (int i = 0; i < threadCount(); ++i) result += counters[i].tbHits.load(std::memory_order_relaxed);
+	return result;
+}
+
 void Search::Reset() {
-	while (thread_pool != nullptr && Stop.load() && thread_pool->tasks_active() > 0);
+	if (thread_pool != nullptr && Stop.load()) thread_pool->waitForIdle();
 	BestMove.move = MOVE_NONE;
 	BestMove.score = VALUE_ZERO;
-	NodeCount = 0;
-	QNodeCount = 0;
+	for (int i = 0; i < MAX_THREADS; ++i) counters[i].reset();
 	MaxDepth = 0;
 	PonderMode.store(false);
-	threadLocalData.History.age();
 	searchMoves.clear();
-	threadLocalData.cmHistory.age();
-	threadLocalData.followupHistory.age();
-	threadLocalData.killerManager.clear();
+	threadLocalData.age();
+	if (thread_pool != nullptr) {
+		for (int id = 1; id <= static_cast<int>(thread_pool->size()); ++id) thread_pool->data(id).age();
+	}
 	for (int i = 0; i < PV_MAX_LENGTH; ++i) PVMoves[i] = MOVE_NONE;
 }
 
 void Search::NewGame() {
 	Reset();
-	for (int i = 0; i < 12; ++i) {
-		for (int j = 0; j < 64; ++j)counterMove[i][j] = MOVE_NONE;
+	threadLocalData.pawnTable.resize(settings::options.getInt(settings::OPTION_PAWN_HASH));
+	threadLocalData.clear();
+	if (thread_pool != nullptr) {
+		for (int id = 1; id <= static_cast<int>(thread_pool->size()); ++id) thread_pool->data(id).clear();
 	}
-	threadLocalData.cmHistory.initialize();
-	threadLocalData.History.initialize();
-	threadLocalData.followupHistory.initialize();
+}
+
+void ThreadData::age() {
+	History.age();
+	cmHistory.age();
+	followupHistory.age();
+	killerManager.clear();
+}
+
+void ThreadData::clear() {
+	cmHistory.initialize();
+	History.initialize();
+	followupHistory.initialize();
+	std::fill_n(&counterMoves[0][0], 12 * 64, MOVE_NONE);
+	evalCache.clear();
+	pawnTable.clear();
 }
 
 std::string Search::PrincipalVariation(Position & pos, int depth) {
@@ -72,25 +137,34 @@ void Search::info(Position & pos, int pvIndx, SearchResultType srt) {
 		npos.copy(pos);
 		std::string srtString;
 		if (srt == SearchResultType::FAIL_LOW) srtString = " upperbound"; else if (srt == SearchResultType::FAIL_HIGH) srtString = " lowerbound";
-		uint64_t effectiveTBHits = tbHits > 1 ? tbHits * (settings::parameter.HelperThreads + 1) : tbHits;
+		const int64_t nodes = NodeCount();
 		if (abs(int(BestMove.score)) <= int(VALUE_MATE_THRESHOLD))
-			sync_cout << "info depth " << _depth << " seldepth " << std::max(MaxDepth, _depth) << " multipv " << pvIndx + 1 << " score cp " << (int)BestMove.score << srtString << " nodes " << (settings::parameter.HelperThreads + 1) * NodeCount
-			<< " nps " << (settings::parameter.HelperThreads + 1) * NodeCount * 1000 / _thinkTime << " hashfull " << tt::GetHashFull()
-			<< " tbhits " << effectiveTBHits
+			sync_cout << "info depth " << _depth << " seldepth " << std::max(MaxDepth, _depth) << " multipv " << pvIndx + 1 << " score cp " << (int)BestMove.score << srtString << " nodes " << nodes
+			<< " nps " << nodes * 1000 / _thinkTime << " hashfull " << tt::GetHashFull()
+			<< " tbhits " << TbHits()
 			<< " time " << _thinkTime
 			<< " pv " << PrincipalVariation(npos, _depth) << sync_endl;
 		else {
 			int pliesToMate;
 			if (int(BestMove.score) > 0) pliesToMate = VALUE_MATE - BestMove.score + 1; else pliesToMate = -BestMove.score - VALUE_MATE;
-			sync_cout << "info depth " << _depth << " seldepth " << std::max(MaxDepth, _depth) << " multipv " << pvIndx + 1 << " score mate " << pliesToMate / 2 << srtString << " nodes " << (settings::parameter.HelperThreads + 1) * NodeCount
-				<< " nps " << (settings::parameter.HelperThreads + 1) * NodeCount * 1000 / _thinkTime << " hashfull " << tt::GetHashFull()
-				<< " tbhits " << effectiveTBHits
+			sync_cout << "info depth " << _depth << " seldepth " << std::max(MaxDepth, _depth) << " multipv " << pvIndx + 1 << " score mate " << pliesToMate / 2 << srtString << " nodes " << nodes
+				<< " nps " << nodes * 1000 / _thinkTime << " hashfull " << tt::GetHashFull()
+				<< " tbhits " << TbHits()
 				<< " time " << _thinkTime
 				<< " pv " << PrincipalVariation(npos, _depth) << sync_endl;
 		}
 	}
 }
 
+void Search::StopPondering() {
+	{
+		//The flag is changed while holding the mutex, so that the notification can't get lost between the waiting thread's check and wait
+		std::lock_guard<std::mutex> lock(mtxPonder);
+		PonderMode.store(false);
+	}
+	cvPonder.notify_all();
+}
+
 void Search::debugInfo(std::string info)
 {
 	if (UciOutput) sync_cout << "info string " << info << sync_endl;
@@ -104,10 +178,7 @@ Move Search::GetBestBookMove(Position & pos, ValuatedMove * moves, int moveCount
 	return MOVE_NONE;
 }
 
-Search::Search() {
-	for (int i = 0; i < 12; ++i)
-		for (int j = 0; j < 64; ++j)
-			counterMove[i][j] = MOVE_NONE;
+Search::Search() : counters(allocateCounters()) {
 	BestMove.move = MOVE_NONE;
 	BestMove.score = VALUE_NOTYETDETERMINED;
 	threadLocalData.cmHistory.initialize();
@@ -118,6 +189,12 @@ Search::Search() {
 }
 
 Search::~Search() {
+	if (thread_pool != nullptr) {
+		//Wait until all helper threads have finished, as they are still accessing this search object
+		delete thread_pool;
+		thread_pool = nullptr;
+	}
+	freeCounters(counters);
 	if (book != nullptr) {
 		delete book;
 		book = nullptr;
@@ -141,8 +218,10 @@ ValuatedMove Search::Think(Position & pos) {
 	ponderMove = MOVE_NONE;
 	Value score = VALUE_ZERO;
 	ValuatedMove lastBestMove = VALUATED_MOVE_NONE;
+	registerMoveStack(&threadLocalData.moveStack);
 	rootPosition = pos;
 	rootPosition.ResetPliesFromRoot();
+	rootPosition.InitializeHashHistory();
 	settings::parameter.EngineSide = rootPosition.GetSideToMove();
 	tt::newSearch();
 	//Get all root moves
@@ -193,14 +272,14 @@ ValuatedMove Search::Think(Position & pos) {
 	//Root probing of tablebases. This is done as suggested by SF: Keep only the winning, resp. drawing, moves in the move list
 	//and then search normally. This way the engine will play "better" than by simply choosing the "best" tablebase move (which is
 	//the move which minimizes the number until drawPlyCount is reset without changing the result
-	tbHits = 0;
+	for (int i = 0; i < MAX_THREADS; ++i) counters[i].tbHits.store(0, std::memory_order_relaxed);
 	probeTB = tablebases::MaxCardinality > 0;
 	if (rootPosition.GetMaterialTableEntry()->IsTablebaseEntry()) {
 		probeTB = false;
 		tablebases::RootMoves tbMoves;
 		for (int i = 0; i < rootMoveCount; ++i) tbMoves.emplace_back(rootMoves[i].move);
 		if (tablebases::rank_root_moves(rootPosition, tbMoves)) {
-			++tbHits;
+			SearchCounters::increment(counters[0].tbHits);
 			for (int i = 0; i < rootMoveCount; ++i) {
 				rootMoves[i].move = tbMoves[i].pv[0];
 				rootMoves[i].score = tbMoves[i].tbScore;
@@ -228,17 +307,36 @@ ValuatedMove Search::Think(Position & pos) {
 		}
 		return BestMove;
 	}
+	if (thread_pool != nullptr) {
+		//Helpers must have finished the previous search before Stop is reset. Helper threads are only recreated, when the number
+		//of threads has been changed (in single thread mode the pool with all helper data is released)
+		thread_pool->waitForIdle();
+		if (static_cast<int>(thread_pool->size()) != settings::parameter.HelperThreads) {
+			delete thread_pool;
+			thread_pool = nullptr;
+		}
+	}
+	//Cached static evaluations include the contempt, whose sign depends on the side to move at root. Therefore the
+	//evaluation caches are cleared whenever the contempt differs from the one they have been filled with
+	if (Contempt.mgScore != evalCacheContempt.mgScore || Contempt.egScore != evalCacheContempt.egScore) {
+		evalCacheContempt = Contempt;
+		threadLocalData.evalCache.clear();
+		if (thread_pool != nullptr) {
+			for (int id = 1; id <= static_cast<int>(thread_pool->size()); ++id) thread_pool->data(id).evalCache.clear();
+		}
+	}
+	nodeLimit = timeManager.GetMaxNodes() != INT64_MAX;
+	stopCheckMask = nodeLimit ? MASK_NODE_CHECK : MASK_TIME_CHECK;
 	Stop.store(false);
 	if (settings::parameter.HelperThreads) {
 		if (thread_pool == nullptr) thread_pool = new ThreadPool(settings::parameter.HelperThreads);
-		else if (static_cast<int>(thread_pool->size()) != settings::parameter.HelperThreads) {
-			delete thread_pool;
-			thread_pool = new ThreadPool(settings::parameter.HelperThreads);
-		}
-		for (int i = 0; i < settings::parameter.HelperThreads; ++i)
-			thread_pool->enqueue(std::bind(&Search::startHelper, this, std::placeholders::_1));
+		thread_pool->startAll(std::bind(&Search::startHelper, this, std::placeholders::_1));
 	}
 	threadLocalData.id = 0;
+	threadLocalData.evalCache.resize(settings::options.getInt(settings::OPTION_EVAL_CACHE));
+	threadLocalData.pawnTable.resize(settings::options.getInt(settings::OPTION_PAWN_HASH));
+	pawn::registerTable(&threadLocalData.pawnTable);
+	tt::registerThread(0);
 	//Iterativ Deepening Loop
 	for (_depth = 1; _depth < timeManager.GetMaxDepth(); ++_depth) {
 		Value alpha, beta, delta = Value(20);
@@ -301,7 +399,7 @@ ValuatedMove Search::Think(Position & pos) {
 			_thinkTime = std::max(tNow - timeManager.GetStartTime(), int64_t(1));
 			if (!Stopped()) {
 				//check if new deeper iteration shall be started
-				if (!timeManager.ContinueSearch(_depth, BestMove, NodeCount, tNow, PonderMode)) {
+				if (!timeManager.ContinueSearch(_depth, BestMove, NodeCount(), tNow, PonderMode)) {
 					Stop.store(true);
 				}
 			}
@@ -314,12 +412,15 @@ ValuatedMove Search::Think(Position & pos) {
 		lastBestMove = BestMove;
 	}
 	Stop.store(true);
+	//Callers may access the search's data as soon as Think has returned
+	if (thread_pool != nullptr) thread_pool->waitForIdle();
 END://when pondering engine must not return a best move before opponent moved => therefore let main thread wait	
-	bool infoSent = false;
-	while (PonderMode.load()) {
-		if (!infoSent) utils::debugInfo("Waiting for opponent..");
-		infoSent = true;
-		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	pawn::registerTable(nullptr);
+	registerMoveStack(nullptr);
+	if (PonderMode.load()) {
+		utils::debugInfo("Waiting for opponent..");
+		std::unique_lock<std::mutex> lock(mtxPonder);
+		cvPonder.wait(lock, [this] { return !PonderMode.load(); });
 	}
 	if (PVMoves[0] != MOVE_NONE && PVMoves[0] != BestMove.move) {
 		std::stringstream ss;
@@ -332,23 +433,44 @@ END://when pondering engine must not return a best move before opponent moved =>
 	return BestMove;
 }
 
+//Skip blocks used to spread the helper threads over different depths (scheme from SF): helper i searches
+//alternately SkipSize[i] depths and skips the next SkipSize[i] depths, starting at an offset of SkipPhase[i]
+const int SKIP_TABLE_SIZE = 20;
+const int SkipSize[SKIP_TABLE_SIZE] = { 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4 };
+const int SkipPhase[SKIP_TABLE_SIZE] = { 0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7 };
+
 //slave thread
 void Search::startHelper(int id) {
 #ifdef _DEBUG
 	sync_cout << "Helper task " << id << " started" << sync_endl;
 #endif // _DEBUG
 	WinProcGroup::bindThisThread(id);
+	tt::registerThread(id);
+	rootPosition.InitializeHashHistory();
 	int depth = 1;
-	Move* PVMovesLocal = new Move[PV_MAX_LENGTH];
+	ThreadData& h = thread_pool->data(id);
+	Move* PVMovesLocal = h.PVMoves;
 	ValuatedMove lastBestMove = VALUATED_MOVE_NONE;
-	ValuatedMove* moves = new ValuatedMove[MAX_MOVE_COUNT];
+	ValuatedMove* moves = h.rootMoves;
 	memcpy(moves, rootMoves, MAX_MOVE_COUNT * sizeof(ValuatedMove));
-	ThreadData* h = new ThreadData;
-	h->id = id;
+	h.id = id;
+	h.evalCache.resize(settings::options.getInt(settings::OPTION_EVAL_CACHE));
+	h.pawnTable.resize(settings::options.getInt(settings::OPTION_PAWN_HASH));
+	pawn::registerTable(&h.pawnTable);
+	registerMoveStack(&h.moveStack);
+	//Diversification: to avoid that all helpers search the same tree as the master, they skip depths depending on their id
+	//and start with different aspiration window sizes
+	const bool diversify = settings::options.getBool(settings::OPTION_SMP_DIVERSIFICATION);
+	const int skipIndex = (id - 1) % SKIP_TABLE_SIZE;
+	const Value initialDelta = diversify ? Value(16 + 4 * ((id - 1) % 4)) : Value(20);
 	//Iterative Deepening Loop
 	Value score = VALUE_ZERO;
 	while (!Stop.load() && depth < MAX_DEPTH) {
-		Value alpha, beta, delta = Value(20);
+		if (diversify && ((depth + SkipPhase[skipIndex]) / SkipSize[skipIndex]) % 2) {
+			++depth;
+			continue;
+		}
+		Value alpha, beta, delta = initialDelta;
 		if (depth >= 5) {
 			//set aspiration window
 			alpha = std::max(score - delta, -VALUE_INFINITE);
@@ -360,7 +482,7 @@ void Search::startHelper(int id) {
 		}
 		while (true && !Stop.load()) {
 			CHECK(rootPosition.GetPliesFromRoot() == 0)
-				score = SearchRoot<ThreadType::SLAVE>(alpha, beta, rootPosition, depth, moves, PVMovesLocal, *h);
+				score = SearchRoot<ThreadType::SLAVE>(alpha, beta, rootPosition, depth, moves, PVMovesLocal, h);
 			CHECK(rootPosition.GetPliesFromRoot() == 0)
 				if (score <= alpha) {
 					//fail-low
@@ -391,9 +513,8 @@ void Search::startHelper(int id) {
 		lastBestMove = moves[0];
 		++depth;
 	}
-	delete h;
-	delete[] moves;
-	delete[] PVMovesLocal;
+	pawn::registerTable(nullptr);
+	registerMoveStack(nullptr);
 #ifdef _DEBUG
 	sync_cout << "Helper task " << id << " done" << sync_endl;
 #endif // _DEBUG
@@ -453,13 +574,13 @@ void Search::updateCutoffStats(ThreadData & tlData, const Move cutoffMove, int d
 		if ((lastApplied = FixCastlingMove(pos.GetLastAppliedMove())) != MOVE_NONE) {
 			prevTo = to(lastApplied);
 			prevPiece = pos.GetPieceOnSquare(prevTo);
-			counterMove[int(pos.GetPieceOnSquare(prevTo))][prevTo] = cutoffMove;
+			tlData.counterMoves[int(pos.GetPieceOnSquare(prevTo))][prevTo] = cutoffMove;
 			tlData.cmHistory.update(-depth * tlData.cmHistory.getValue(prevPiece, prevTo, movingPiece, toSquare) / 64, prevPiece, prevTo, movingPiece, toSquare);
 			tlData.cmHistory.update(v, prevPiece, prevTo, movingPiece, toSquare);
 			Move lastApplied2;
-			if (pos.Previous() && (lastApplied2 = FixCastlingMove(pos.Previous()->GetLastAppliedMove())) != MOVE_NONE) {
+			if ((lastApplied2 = FixCastlingMove(pos.GetPreviousLastAppliedMove())) != MOVE_NONE) {
 				prev2To = to(lastApplied2);
-				prev2Piece = pos.Previous()->GetPieceOnSquare(prev2To);
+				prev2Piece = pos.GetPreviousLastMovingPiece();
 				tlData.followupHistory.update(-depth * tlData.followupHistory.getValue(prev2Piece, prev2To, movingPiece, toSquare) / 64, prev2Piece, prev2To, movingPiece, toSquare);
 				tlData.followupHistory.update(v, prev2Piece, prev2To, movingPiece, toSquare);
 			}
@@ -503,35 +624,58 @@ ThreadPool::~ThreadPool()
 	stop();
 }
 
-void ThreadPool::enqueue(Task t)
+void ThreadPool::startAll(Task task)
 {
 	{
 		std::unique_lock<std::mutex> lock(mtxStartTask);
-		tasks.emplace(t);
+		this->task = task;
+		//helpers are counted as active before they are woken up, so that nobody sees an idle pool before they have started
+		active.store(static_cast<int>(threads.size()));
+		++generation;
 	}
-	cvStartTask.notify_one();
+	cvStartTask.notify_all();
+}
+
+void ThreadPool::waitForIdle()
+{
+	std::unique_lock<std::mutex> lock(mtxStartTask);
+	cvIdle.wait(lock, [this] { return active.load() == 0; });
 }
 
 void ThreadPool::start(size_t numberOfThreads)
 {
+	threadData.resize(numberOfThreads);
+	//Each helper counts as active until it has allocated its ThreadData
+	active.store(static_cast<int>(numberOfThreads));
 	for (auto i = 0u; i < numberOfThreads; ++i) {
 		threads.emplace_back([=] {
+			//The thread data is allocated by the helper itself after binding, so that on NUMA systems its memory
+			//is placed on the node the helper runs on
+			WinProcGroup::bindThisThread(i + 1);
+			threadData[i].reset(new ThreadData);
+			{
+				std::lock_guard<std::mutex> lock(mtxStartTask);
+				if (active.fetch_sub(1) == 1) cvIdle.notify_all();
+			}
+			uint64_t started = 0;
 			while (true) {
-				Task task;
+				Task current;
 				{
 					std::unique_lock<std::mutex> lock(mtxStartTask);
-					cvStartTask.wait(lock, [=] { return shutdown || !tasks.empty(); });
+					cvStartTask.wait(lock, [&] { return shutdown || generation != started; });
 
 					if (shutdown) break;
-					task = std::move(tasks.front());
-					tasks.pop();
+					started = generation;
+					current = task;
 				}
-				active.fetch_add(1);
-				task(i + 1);
-				active.fetch_sub(1);
+				current(i + 1);
+				std::lock_guard<std::mutex> lock(mtxStartTask);
+				if (active.fetch_sub(1) == 1) cvIdle.notify_all();
 			}
 			});
 	}
+	//The thread data of all helpers has to be available before the first task is started
+	waitForIdle();
 }
 
 void ThreadPool::stop() noexcept
@@ -545,3 +689,4 @@ void ThreadPool::stop() noexcept
 	for (auto& th : threads) th.join();
 	threads.clear();
 }
+
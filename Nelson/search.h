@@ -8,7 +8,7 @@
 #include <mutex>
 #include <unordered_map>
 #include <functional>
-#include <queue>
+#include <memory>
 #include <condition_variable>
 #include "types.h"
 #include "book.h"
@@ -23,19 +23,78 @@
 enum struct ThreadType { SINGLE, MASTER, SLAVE };
 enum struct SearchResultType { EXACT_RESULT, FAIL_LOW, FAIL_HIGH, TABLEBASE_MOVE, UNIQUE_MOVE, BOOK_MOVE };
 
+//Node and tablebase hit counters are collected per thread and summed on demand. Each thread has it's own cache line, so that
+//the threads don't invalidate each other's cache lines when counting
+struct alignas(64) SearchCounters {
+	std::atomic<int64_t> nodes{ 0 };
+	std::atomic<int64_t> qnodes{ 0 };
+	std::atomic<int64_t> tbHits{ 0 };
+
+	void reset();
+	//Counters are only changed by the owning thread, so that a relaxed load and store is sufficient (no locked instruction needed)
+	static inline int64_t increment(std::atomic<int64_t> & counter) {
+		const int64_t value = counter.load(std::memory_order_relaxed) + 1;
+		counter.store(value, std::memory_order_relaxed);
+		return value;
+	}
+};
+
+//Struct contains thread local data, which isn't shared among threads
+struct ThreadData {
+	int id = 0;
+	//History tables used in move ordering during search
+	MoveSequenceHistoryManager cmHistory;
+	MoveSequenceHistoryManager followupHistory;
+	HistoryManager History;
+	killer::Manager killerManager;
+	//Counter moves indexed by piece and target square of the previous move
+	Move counterMoves[12][64];
+	//Cache of static evaluations
+	evalcache::Table evalCache;
+	//Pawn hash table
+	pawn::Table pawnTable;
+	//Move lists of the positions searched by the thread
+	MoveStack moveStack {};
+	//Root move list and PV of helper threads (the master thread uses Search::rootMoves and Search::PVMoves)
+	ValuatedMove rootMoves[MAX_MOVE_COUNT];
+	Move PVMoves[PV_MAX_LENGTH];
+
+	ThreadData() { std::fill_n(&counterMoves[0][0], 12 * 64, MOVE_NONE); }
+	//Ages the history tables and clears the killer moves before the next search
+	void age();
+	//Resets the history tables and caches for a new game
+	void clear();
+};
+
+/* Pool of persistent helper threads. Each helper owns its ThreadData, which is kept from one search to the next, so that
+   neither the tables have to be allocated again nor the learned history is lost. The ThreadData is allocated by the helper
+   itself after binding it to its processor group/NUMA node. The pool is created for a fixed number
+   of threads and has to be recreated when the number of threads changes.
+   All helpers wait at a start barrier and run the task passed to startAll (with their id 1..size as parameter) when the barrier is opened
+*/
 class ThreadPool {
 public:
 	using Task = std::function<void(int)>;
 	explicit ThreadPool(size_t numberOfThreads);
 	~ThreadPool();
-	void enqueue(Task t);
-	std::queue<Task> tasks;
+	//Opens the start barrier: all helper threads run the task once
+	void startAll(Task task);
+	//Blocks until all helper threads have finished their task
+	void waitForIdle();
 	inline size_t size() { return threads.size(); }
 	inline int tasks_active() { return active.load(); }
+	//Thread local data owned by the helper thread with the given id (1..size)
+	inline ThreadData & data(int id) { return *threadData[id - 1]; }
 private:
 	std::vector<std::thread> threads;
+	std::vector<std::unique_ptr<ThreadData>> threadData;
+	Task task;
 	std::condition_variable cvStartTask;
+	//Signalled when the last active helper has finished its task
+	std::condition_variable cvIdle;
 	std::mutex mtxStartTask;
+	//Incremented whenever the start barrier is opened
+	uint64_t generation = 0;
 	bool shutdown = false;
 	std::atomic<int> active{ 0 };
 
@@ -43,16 +102,6 @@ private:
 	void stop() noexcept;
 };
 
-//Struct contains thread local data, which isn't shared among threads
-struct ThreadData {
-	int id;
-	//History tables used in move ordering during search
-	MoveSequenceHistoryManager cmHistory;
-	MoveSequenceHistoryManager followupHistory;
-	HistoryManager History;
-	killer::Manager killerManager;
-};
-
 class Search {
 public:
 	bool UciOutput = false;
@@ -61,10 +110,6 @@ public:
 	std::atomic<bool> PonderMode{ false };
 	//The search's result (will be updated while searching)
 	ValuatedMove BestMove;
-	//Total Node Count (including nodes from Quiescence Search)
-	int64_t NodeCount = 0;
-	//Quiescence Search Node Count
-	int64_t QNodeCount = 0;
 	//Maximum Depth reached during Search
 	int MaxDepth = 0;
 	//Flag, indicating that search shall stop as soon as possible 
@@ -90,15 +135,25 @@ public:
 	void NewGame();
 	//Returns the current nominal search depth
 	inline int Depth() const { return _depth; }
+	//Total Node Count of all threads (including nodes from Quiescence Search)
+	int64_t NodeCount() const;
+	//Quiescence Search Node Count of all threads
+	int64_t QNodeCount() const;
+	//Tablebase hits of all threads
+	int64_t TbHits() const;
 	//Returns the thinkTime needed so far (is updated after every iteration)
 	inline Time_t ThinkTime() const { return _thinkTime; }
 	//Determines the move the engine assumes that the opponent is playing
 	inline Move PonderMove() const { return ponderMove; }
+	//Returns the master thread's evaluation cache (for statistics)
+	inline const evalcache::Table & EvalCache() const { return threadLocalData.evalCache; }
 	//Stops the current search immediatialy
 	inline void StopThinking() {
-		PonderMode.store(false);
+		StopPondering();
 		Stop.store(true);
 	}
+	//Ends ponder mode (ponderhit) and wakes up the search, if it has already finished and is waiting for the opponent's move
+	void StopPondering();
 	//Get's the "best" move from the polyglot opening book
 	Move GetBestBookMove(Position& pos, ValuatedMove * moves, int moveCount);
 	//handling of the thinking output for uci and xboard
@@ -108,7 +163,7 @@ public:
 
 	Search();
 	~Search();
-	//Main entry point 
+	//Main entry point
 	ValuatedMove Think(Position &pos);
 	//In case of SMP, start Slave threads
 	void startHelper(int id);
@@ -123,6 +178,9 @@ public:
 private:
 	//Mutex to synchronize access to analysis output
 	std::mutex mtxXAnalysisOutput;
+	//Used to let the search wait for the end of pondering, before returning the best move
+	std::mutex mtxPonder;
+	std::condition_variable cvPonder;
 	//Polyglot book object to read book moves
 	polyglot::Book * book = nullptr;
 
@@ -139,14 +197,23 @@ private:
 	Move ponderMove = MOVE_NONE;
 	int _depth = 0;
 	Time_t _thinkTime;
-	Move counterMove[12][64];
-	uint64_t tbHits = 0;
+	//Counters indexed by thread id (MAX_THREADS entries). SearchCounters are over-aligned, which isn't supported by operator new
+	//in C++11, therefore the counters are kept in a separately allocated block instead of being a member array
+	SearchCounters * counters;
 	//Flag indicating whether TB probes shall be made during search
 	bool probeTB = true;
+	//With a node limit all threads check the summed node count (and more often than the time), as otherwise the helpers
+	//would overshoot the limit
+	bool nodeLimit = false;
+	int64_t stopCheckMask = MASK_TIME_CHECK;
+	//Contempt included in the static evaluations stored in the evaluation caches
+	Eval evalCacheContempt;
 
 	std::unordered_map<Move, Value> rootMoveBoni;
 
 	ThreadPool * thread_pool = nullptr;
+	//Number of threads (master + helpers) whose counters contribute to the totals
+	inline int threadCount() const { return thread_pool != nullptr ? static_cast<int>(thread_pool->size()) + 1 : 1; }
 
 	inline bool Stopped() { return Stop; }
 
@@ -160,6 +227,14 @@ private:
 	template<ThreadType T> Value QSearch(Value alpha, Value beta, Position &pos, int depth, ThreadData& tlData);
 	//Updates killer, history and counter move history tables, whenever a cutoff has happened
 	void updateCutoffStats(ThreadData& tlData, const Move cutoffMove, int depth, Position &pos, int moveIndex);
+	//Static evaluation using the thread's evaluation cache (pos must already be known to be not final)
+	inline Value evaluate(Position &pos, ThreadData& tlData) {
+		Value value = pos.GetStaticEval();
+		if (value != VALUE_NOTYETDETERMINED) return value;
+		if (tlData.evalCache.probe(pos.GetHash(), value)) pos.SetStaticEval(value);
+		else tlData.evalCache.store(pos.GetHash(), value = pos.evaluate());
+		return value;
+	}
 	//Thread id (0: MASTER or SINGLE, SLAVES are sequentially numbered starting with 1
 
 };
@@ -240,11 +315,9 @@ template<ThreadType T> Value Search::SearchRoot(Value alpha, Value beta, Positio
 
 //This is the main alpha-beta search routine
 template<ThreadType T> Value Search::SearchMain(Value alpha, Value beta, Position &pos, int depth, Move * pv, ThreadData& tlData, bool cutNode, bool prune, Move excludeMove) {
-	if (T != ThreadType::SLAVE) {
-		if (depth > 0) {
-			++NodeCount;
-		}
-		if (!Stop && ((NodeCount & MASK_TIME_CHECK) == 0 && timeManager.ExitSearch(NodeCount))) Stop.store(true);
+	if (depth > 0) {
+		const int64_t nodes = SearchCounters::increment(counters[tlData.id].nodes);
+		if ((T != ThreadType::SLAVE || nodeLimit) && !Stop && ((nodes & stopCheckMask) == 0 && timeManager.ExitSearch(NodeCount()))) Stop.store(true);
 	}
 	if (Stopped()) return VALUE_ZERO;
 	if (pos.GetResult() != Result::OPEN)  return pos.evaluateFinalPosition();
@@ -252,6 +325,11 @@ template<ThreadType T> Value Search::SearchMain(Value alpha, Value beta, Positio
 	alpha = Value(std::max(int(-VALUE_MATE) + pos.GetPliesFromRoot(), int(alpha)));
 	beta = Value(std::min(int(VALUE_MATE) - pos.GetPliesFromRoot() - 1, int(beta)));
 	if (alpha >= beta) return SCORE_MDP(alpha);
+	//If the side to move can repeat a position of the search path, the score is at least a draw
+	if (alpha < VALUE_DRAW && pos.hasUpcomingRepetition(pos.GetPliesFromRoot())) {
+		alpha = VALUE_DRAW;
+		if (alpha >= beta) return SCORE_REP(alpha);
+	}
 	//If depth = 0 is reached go to Quiescence Search
 	if (depth <= 0) {
 		return QSearch<T>(alpha, beta, pos, 0, tlData);
@@ -281,7 +359,7 @@ template<ThreadType T> Value Search::SearchMain(Value alpha, Value beta, Positio
 		tablebases::WDLScore wdl = tablebases::probe_wdl(pos, &state);
 		if (state != tablebases::ProbeState::FAIL)
 		{
-			if (T != ThreadType::SLAVE) tbHits++;
+			SearchCounters::increment(counters[tlData.id].tbHits);
 			Value value = wdl == tablebases::WDLLoss ? -VALUE_MATE + MAX_DEPTH + pos.GetPliesFromRoot()
 				: wdl == tablebases::WDLWin ? VALUE_MATE - MAX_DEPTH - pos.GetPliesFromRoot()
 				: VALUE_DRAW + 2 * static_cast<int>(wdl);
@@ -301,7 +379,7 @@ template<ThreadType T> Value Search::SearchMain(Value alpha, Value beta, Positio
 		pos.SetStaticEval(staticEvaluation);
 	}
 	else
-		staticEvaluation = pos.evaluate();
+		staticEvaluation = evaluate(pos, tlData);
 	prune = prune && !PVNode && !checked && (pos.GetLastAppliedMove() != MOVE_NONE) && (!pos.GetMaterialTableEntry()->SkipPruning());
 
 	if (ttFound &&
@@ -340,9 +418,10 @@ template<ThreadType T> Value Search::SearchMain(Value alpha, Value beta, Positio
 			if (int(staticEvaluation - beta) > int(settings::parameter.PieceValues[PAWN].egScore)) ++reduction;
 			Square epsquare = pos.GetEPSquare();
 			Move lastApplied = pos.GetLastAppliedMove();
+			int pliesFromNull = pos.GetPliesFromNull();
 			pos.NullMove();
 			Value nullscore = -SearchMain<T>(-beta, -beta + 1, pos, depth - reduction, subpv, tlData, !cutNode, false);
-			pos.NullMove(epsquare, lastApplied);
+			pos.NullMove(epsquare, lastApplied, pliesFromNull);
 			if (nullscore >= beta) {
 				if (nullscore >= VALUE_MATE_THRESHOLD) nullscore = beta;
 				if (depth < 9 && beta < VALUE_KNOWN_WIN) return SCORE_NMP(nullscore);
@@ -360,8 +439,13 @@ template<ThreadType T> Value Search::SearchMain(Value alpha, Value beta, Positio
 			Value rbeta = std::min(Value(beta + 90), VALUE_INFINITE);
 			int rdepth = depth - 4;
 
+#ifdef MAKE_UNMAKE
+			//The ProbCut moves are searched in place, the move list of pos is initialized again before its own move loop
+			Position & cpos = pos;
+#else
 			Position cpos(pos);
 			cpos.copy(pos);
+#endif
 			Value limit = settings::parameter.PieceValues[GetPieceType(pos.getCapturedInLastMove())].mgScore;
 			Move ttm = ttMove;
 			if (ttm != MOVE_NONE && cpos.SEE(ttMove) < limit) ttm = MOVE_NONE;
@@ -371,21 +455,36 @@ template<ThreadType T> Value Search::SearchMain(Value alpha, Value beta, Positio
 				cpos.InitializeMoveIterator<QSEARCH>(&tlData.History, &tlData.cmHistory, &tlData.followupHistory, nullptr, MOVE_NONE, ttm);
 			Move move;
 			while ((move = cpos.NextMove())) {
-				if (pos.SEE(move) < rbeta - staticEvaluation) continue;
+				if (pos.SEE(move) < rbeta - staticEvaluation || !cpos.isLegal(move)) continue;
+#ifdef MAKE_UNMAKE
+				if (cpos.DoMove(move)) {
+					Value score = -SearchMain<T>(-rbeta, Value(-rbeta + 1), cpos, rdepth, subpv, tlData, !cutNode);
+					cpos.UndoMove(move);
+					if (score >= rbeta)
+						return SCORE_PC(score);
+				}
+				else cpos.UndoMove(move);
+#else
 				Position next(cpos);
 				if (next.ApplyMove(move)) {
 					Value score = -SearchMain<T>(-rbeta, Value(-rbeta + 1), next, rdepth, subpv, tlData, !cutNode);
 					if (score >= rbeta)
 						return SCORE_PC(score);
 				}
+#endif
 			}
 		}
 	}
 	//Internal Iterative Deepening - it seems as IID helps as well if the found hash entry has very low depth
 	int iidDepth = PVNode ? depth - 2 : depth / 2;
 	if ((!ttMove || ttEntry.depth() < iidDepth) && (PVNode ? depth > 3 : depth > 6)) {
+#ifdef MAKE_UNMAKE
+		//IID is searched in place (like ProbCut)
+		Position & next = pos;
+#else
 		Position next(pos);
 		next.copy(pos);
+#endif
 		//If there is no hash move, we are looking for a move => therefore search should be called with prune = false
 		SearchMain<T>(alpha, beta, next, iidDepth, subpv, tlData, cutNode, ttMove != MOVE_NONE);
 		if (Stopped()) return VALUE_ZERO;
@@ -395,7 +494,7 @@ template<ThreadType T> Value Search::SearchMain(Value alpha, Value beta, Positio
 	if (!checked && ttFound && ttEntry.evalValue() != VALUE_NOTYETDETERMINED && pos.GetStaticEval() == VALUE_NOTYETDETERMINED) pos.SetStaticEval(ttEntry.evalValue());
 	//bool regular = !checked && pos.GetLastAppliedMove() != MOVE_NONE && pos.Previous()->GetLastAppliedMove() != MOVE_NONE && !pos.Previous()->Previous()->Checked();
 	//bool improving = regular && pos.Previous()->Previous()->GetStaticEval() < pos.GetStaticEval();
-	Move counter = pos.GetCounterMove(counterMove);
+	Move counter = pos.GetCounterMove(tlData.counterMoves);
 	Value bestScore = -VALUE_MATE;
 	//Futility Pruning I: If quiet moves can't raise alpha, only generate tactical moves and moves which give check
 	bool futilityPruning = pos.GetLastAppliedMove() != MOVE_NONE
@@ -417,7 +516,8 @@ template<ThreadType T> Value Search::SearchMain(Value alpha, Value beta, Positio
 	int moveIndex = -1;
 	int bestMoveIndex = -1;
 	bool ZWS = !PVNode;
-	Square recaptureSquare = pos.GetLastAppliedMove() != MOVE_NONE && pos.Previous()->GetPieceOnSquare(to(pos.GetLastAppliedMove())) != BLANK ? to(pos.GetLastAppliedMove()) : OUTSIDE;
+	Square recaptureSquare = pos.GetLastAppliedMove() != MOVE_NONE && pos.GetPreviousMovingPiece() != BLANK ? to(pos.GetLastAppliedMove()) : OUTSIDE;
+	const int phase = pos.GetMaterialTableEntry()->Phase;
 	bool trySE = depth >= 8 && ttMove != MOVE_NONE && abs(ttValue) < VALUE_KNOWN_WIN
 		&& excludeMove == MOVE_NONE && (ttEntry.type() == tt::LOWER_BOUND || ttEntry.type() == tt::EXACT) && ttEntry.depth() >= depth - 3;
 	tlData.killerManager.enterLevel(pos);
@@ -434,66 +534,103 @@ template<ThreadType T> Value Search::SearchMain(Value alpha, Value beta, Positio
 				if (!pos.givesCheck(move)) continue;
 			}
 		}
+		if (!pos.isLegal(move)) continue;
+		//The move generation state of pos is needed after the move has been applied (with make/unmake pos is the successor then)
+		const bool quietPhase = pos.QuietMoveGenerationPhaseStarted();
+		const bool singleReply = moveIndex == 0 && pos.GeneratedMoveCount() == 1 && (pos.GetMoveGenerationPhase() == MoveGenerationType::CHECK_EVASION || quietPhase);
+#ifdef MAKE_UNMAKE
+		const bool safeCheck = pos.givesCheck(move) && pos.SEE_Sign(move) >= VALUE_ZERO;
+		if (!pos.DoMove(move)) {
+			pos.UndoMove(move);
+			continue;
+		}
+		Position & next = pos;
+#else
 		Position next(pos);
-		if (next.ApplyMove(move)) {
-			//critical = critical || GetPieceType(pos.GetPieceOnSquare(from(move))) == PAWN && ((pos.GetSideToMove() == WHITE && from(move) > H5) || (pos.GetSideToMove() == BLACK && from(move) < A4));
-			//Check extension
-			int extension;
-			if (next.GetMaterialTableEntry()->Phase == 256 && pos.GetMaterialTableEntry()->Phase < 256 && next.GetMaterialScore() >= -settings::parameter.PieceValues[PAWN].egScore && next.GetMaterialScore() <= settings::parameter.PieceValues[PAWN].egScore)
-				extension = 3;
-			else extension = (next.Checked() && pos.SEE_Sign(move) >= VALUE_ZERO) ? 1 : 0;
-			if (!extension && to(move) == recaptureSquare) {
-				++extension;
-			}
-			if (trySE && move == ttMove && !extension)
-			{
-				Value rBeta = ttValue - 2 * depth;
-				Position spos(pos);
-				spos.copy(pos);
-				if (SearchMain<T>(rBeta - 1, rBeta, spos, std::max(5, depth / 3), subpv, tlData, cutNode, true, move) < rBeta) ++extension;
-			}
-			if (!extension && moveIndex == 0 && pos.GeneratedMoveCount() == 1 && (pos.GetMoveGenerationPhase() == MoveGenerationType::CHECK_EVASION || pos.QuietMoveGenerationPhaseStarted())) {
-				++extension;
-			}
-			int reduction = 0;
-			//LMR: Late move reduction
-			if (lmr && moveIndex != 0 && move != counter && pos.QuietMoveGenerationPhaseStarted()) {
-				reduction = settings::parameter.LMRReduction(depth, moveIndex);
-				if (cutNode) ++reduction;
-				if ((PVNode || extension) && reduction > 0) --reduction;
-			}
-			if (ZWS) {
-				score = -SearchMain<T>(Value(-alpha - 1), -alpha, next, depth - 1 - reduction + extension, subpv, tlData, !cutNode);
-				if (score > alpha && reduction)
-					score = -SearchMain<T>(Value(-alpha - 1), -alpha, next, depth - 1 + extension, subpv, tlData, !cutNode);
-				if (score > alpha && score < beta) {
-					score = -SearchMain<T>(-beta, -alpha, next, depth - 1 + extension, subpv, tlData, false);
-				}
-			}
-			else {
-				score = -SearchMain<T>(-beta, -alpha, next, depth - 1 - reduction + extension, subpv, tlData, (PVNode ? false : !cutNode));
-				if (score > alpha && reduction > 0) {
-					score = -SearchMain<T>(-beta, -alpha, next, depth - 1 + extension, subpv, tlData, (PVNode ? false : !cutNode));
-				}
+		if (!next.ApplyMove(move)) continue;
+#endif
+		//critical = critical || GetPieceType(pos.GetPieceOnSquare(from(move))) == PAWN && ((pos.GetSideToMove() == WHITE && from(move) > H5) || (pos.GetSideToMove() == BLACK && from(move) < A4));
+		//Check extension
+		int extension;
+		if (next.GetMaterialTableEntry()->Phase == 256 && phase < 256 && next.GetMaterialScore() >= -settings::parameter.PieceValues[PAWN].egScore && next.GetMaterialScore() <= settings::parameter.PieceValues[PAWN].egScore)
+			extension = 3;
+#ifdef MAKE_UNMAKE
+		else extension = safeCheck ? 1 : 0;
+#else
+		else extension = (next.Checked() && pos.SEE_Sign(move) >= VALUE_ZERO) ? 1 : 0;
+#endif
+		if (!extension && to(move) == recaptureSquare) {
+			++extension;
+		}
+		if (trySE && move == ttMove && !extension)
+		{
+			Value rBeta = ttValue - 2 * depth;
+#ifdef MAKE_UNMAKE
+			//The singular extension search is done from this position, not from the successor
+			pos.UndoMove(move);
+#endif
+			//The singular extension search uses the move list of this position's ply
+			const MoveIterator moveIterator = pos.GetMoveIterator();
+#ifdef MAKE_UNMAKE
+			Position & spos = pos;
+#else
+			Position spos(pos);
+			spos.copy(pos);
+#endif
+			if (SearchMain<T>(rBeta - 1, rBeta, spos, std::max(5, depth / 3), subpv, tlData, cutNode, true, move) < rBeta) ++extension;
+			pos.SetMoveIterator(moveIterator);
+#ifdef MAKE_UNMAKE
+			pos.DoMove(move);
+#else
+			//The singular extension search has overwritten the successor's hash key in the hash history and its move list
+			next.RestoreHashHistoryEntry();
+			next.ResetMoveGeneration();
+#endif
+		}
+		if (!extension && singleReply) {
+			++extension;
+		}
+		int reduction = 0;
+		//LMR: Late move reduction
+		if (lmr && moveIndex != 0 && move != counter && quietPhase) {
+			reduction = settings::parameter.LMRReduction(depth, moveIndex);
+			if (cutNode) ++reduction;
+			if ((PVNode || extension) && reduction > 0) --reduction;
+		}
+		if (ZWS) {
+			score = -SearchMain<T>(Value(-alpha - 1), -alpha, next, depth - 1 - reduction + extension, subpv, tlData, !cutNode);
+			if (score > alpha && reduction)
+				score = -SearchMain<T>(Value(-alpha - 1), -alpha, next, depth - 1 + extension, subpv, tlData, !cutNode);
+			if (score > alpha && score < beta) {
+				score = -SearchMain<T>(-beta, -alpha, next, depth - 1 + extension, subpv, tlData, false);
 			}
-			if (score >= beta) {
-				updateCutoffStats(tlData, move, depth, pos, moveIndex);
-				//Update transposition table
-				if (T != ThreadType::SINGLE)  ttPointer->update<tt::THREAD_SAFE>(hashKey, tt::toTT(score, pos.GetPliesFromRoot()), tt::LOWER_BOUND, depth, move, staticEvaluation);
-				else ttPointer->update<tt::UNSAFE>(hashKey, tt::toTT(score, pos.GetPliesFromRoot()), tt::LOWER_BOUND, depth, move, staticEvaluation);
-				return SCORE_BC(score);
+		}
+		else {
+			score = -SearchMain<T>(-beta, -alpha, next, depth - 1 - reduction + extension, subpv, tlData, (PVNode ? false : !cutNode));
+			if (score > alpha && reduction > 0) {
+				score = -SearchMain<T>(-beta, -alpha, next, depth - 1 + extension, subpv, tlData, (PVNode ? false : !cutNode));
 			}
-			ZWS = true;
-			if (score > bestScore) {
-				bestScore = score;
-				if (score > alpha)
-				{
-					nodeType = tt::EXACT;
-					alpha = score;
-					pv[0] = move;
-					bestMoveIndex = moveIndex;
-					memcpy(pv + 1, subpv, (PV_MAX_LENGTH - 1) * sizeof(Move));
-				}
+		}
+#ifdef MAKE_UNMAKE
+		pos.UndoMove(move);
+#endif
+		if (score >= beta) {
+			updateCutoffStats(tlData, move, depth, pos, moveIndex);
+			//Update transposition table
+			if (T != ThreadType::SINGLE)  ttPointer->update<tt::THREAD_SAFE>(hashKey, tt::toTT(score, pos.GetPliesFromRoot()), tt::LOWER_BOUND, depth, move, staticEvaluation);
+			else ttPointer->update<tt::UNSAFE>(hashKey, tt::toTT(score, pos.GetPliesFromRoot()), tt::LOWER_BOUND, depth, move, staticEvaluation);
+			return SCORE_BC(score);
+		}
+		ZWS = true;
+		if (score > bestScore) {
+			bestScore = score;
+			if (score > alpha)
+			{
+				nodeType = tt::EXACT;
+				alpha = score;
+				pv[0] = move;
+				bestMoveIndex = moveIndex;
+				memcpy(pv + 1, subpv, (PV_MAX_LENGTH - 1) * sizeof(Move));
 			}
 		}
 	}
@@ -505,12 +642,10 @@ template<ThreadType T> Value Search::SearchMain(Value alpha, Value beta, Positio
 }
 
 template<ThreadType T> Value Search::QSearch(Value alpha, Value beta, Position &pos, int depth, ThreadData& tlData) {
-	if (T != ThreadType::SLAVE) {
-		++QNodeCount;
-		++NodeCount;
-		MaxDepth = std::max(MaxDepth, pos.GetPliesFromRoot());
-		if (!Stop && ((NodeCount & MASK_TIME_CHECK) == 0 && timeManager.ExitSearch(NodeCount))) Stop.store(true);
-	}
+	SearchCounters::increment(counters[tlData.id].qnodes);
+	const int64_t nodes = SearchCounters::increment(counters[tlData.id].nodes);
+	if (T != ThreadType::SLAVE) MaxDepth = std::max(MaxDepth, pos.GetPliesFromRoot());
+	if ((T != ThreadType::SLAVE || nodeLimit) && !Stop && ((nodes & stopCheckMask) == 0 && timeManager.ExitSearch(NodeCount()))) Stop.store(true);
 	if (Stopped()) return VALUE_ZERO;
 	if (pos.GetResult() != Result::OPEN)  return SCORE_FINAL(pos.evaluateFinalPosition());
 	//Mate distance pruning
@@ -539,7 +674,7 @@ template<ThreadType T> Value Search::QSearch(Value alpha, Value beta, Position &
 		standPat = VALUE_NOTYETDETERMINED;
 	}
 	else {
-		standPat = ttFound && ttEntry.evalValue() != VALUE_NOTYETDETERMINED ? ttEntry.evalValue() : pos.evaluate();
+		standPat = ttFound && ttEntry.evalValue() != VALUE_NOTYETDETERMINED ? ttEntry.evalValue() : evaluate(pos, tlData);
 		//check if ttValue is better
 		if (ttFound && ttValue != VALUE_NOTYETDETERMINED && ((ttValue > standPat && ttEntry.type() == tt::LOWER_BOUND) || (ttValue < standPat && ttEntry.type() == tt::UPPER_BOUND))) standPat = ttValue;
 		if (standPat >= beta) {
@@ -567,19 +702,26 @@ template<ThreadType T> Value Search::QSearch(Value alpha, Value beta, Position &
 			}
 			else return standPat + pos.SEE(move);
 		}
+		if (!pos.isLegal(move)) continue;
+#ifdef MAKE_UNMAKE
+		const bool legal = pos.DoMove(move);
+		if (legal) score = -QSearch<T>(-beta, -alpha, pos, depth - 1, tlData);
+		pos.UndoMove(move);
+		if (!legal) continue;
+#else
 		Position next(pos);
-		if (next.ApplyMove(move)) {
-			score = -QSearch<T>(-beta, -alpha, next, depth - 1, tlData);
-			if (score >= beta) {
-				if (T != ThreadType::SINGLE) ttPointer->update<tt::THREAD_SAFE>(pos.GetHash(), beta, tt::LOWER_BOUND, depth, move, standPat);
-				else ttPointer->update<tt::UNSAFE>(pos.GetHash(), beta, tt::LOWER_BOUND, depth, move, standPat);
-				return SCORE_BC(beta);
-			}
-			if (score > alpha) {
-				nt = tt::EXACT;
-				alpha = score;
-				bestMove = move;
-			}
+		if (!next.ApplyMove(move)) continue;
+		score = -QSearch<T>(-beta, -alpha, next, depth - 1, tlData);
+#endif
+		if (score >= beta) {
+			if (T != ThreadType::SINGLE) ttPointer->update<tt::THREAD_SAFE>(pos.GetHash(), beta, tt::LOWER_BOUND, depth, move, standPat);
+			else ttPointer->update<tt::UNSAFE>(pos.GetHash(), beta, tt::LOWER_BOUND, depth, move, standPat);
+			return SCORE_BC(beta);
+		}
+		if (score > alpha) {
+			nt = tt::EXACT;
+			alpha = score;
+			bestMove = move;
 		}
 	}
 	if (T != ThreadType::SINGLE) ttPointer->update<tt::THREAD_SAFE>(pos.GetHash(), alpha, nt, depth, bestMove, standPat);
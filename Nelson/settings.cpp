@@ -128,16 +128,20 @@ namespace settings {
 		}
 		else if (name.find("PIECEVAL_MG_") == 0) {
 			int index = stoi(name.substr(12, std::string::npos));
+			if (PieceValues[index].mgScore == static_cast<Value>(stoi(value))) return;
 			PieceValues[index].mgScore = static_cast<Value>(stoi(value));
 			InitializeMaterialTable();
 		}
 		else if (name.find("PIECEVAL_EG_") == 0) {
 			int index = stoi(name.substr(12, std::string::npos));
+			if (PieceValues[index].egScore == static_cast<Value>(stoi(value))) return;
 			PieceValues[index].egScore = static_cast<Value>(stoi(value));
 			InitializeMaterialTable();
 		}
 		else if (!name.compare("BONUS_BISHOP_PAIR")) {
-			BONUS_BISHOP_PAIR = Eval(static_cast<Value>(stoi(value)));
+			const Eval bonus(static_cast<Value>(stoi(value)));
+			if (BONUS_BISHOP_PAIR.mgScore == bonus.mgScore && BONUS_BISHOP_PAIR.egScore == bonus.egScore) return;
+			BONUS_BISHOP_PAIR = bonus;
 			InitializeMaterialTable();
 		}
 		else if (!name.compare("HANGING_EG")) HANGING.egScore = static_cast<Value>(stoi(value));
@@ -170,15 +174,17 @@ namespace settings {
 		}
 	}
 
-	void Parameters::setParam(std::string key, std::string value)
+	bool Parameters::setParam(std::string key, std::string value)
 	{
 		if (key.find("PIECEVAL_MG_") == 0) {
 			int index = std::stoi(key.substr(12, std::string::npos));
 			PieceValues[index].mgScore = static_cast<Value>(stoi(value));
+			return true;
 		}
 		else if (key.find("PIECEVAL_EG_") == 0) {
 			int index = std::stoi(key.substr(12, std::string::npos));
 			PieceValues[index].egScore = static_cast<Value>(stoi(value));
+			return true;
 		}
 		else if (key.find("MOB_QUEEN_MG_") == 0) {
 			int index = std::stoi(key.substr(13, std::string::npos));
@@ -188,6 +194,7 @@ namespace settings {
 			int index = std::stoi(key.substr(13, std::string::npos));
 			MOBILITY_BONUS_QUEEN[index].egScore = static_cast<Value>(stoi(value));
 		}
+		return false;
 	}
 
 	Option::Option(std::string Name, OptionType Type, std::string DefaultValue, std::string MinValue, std::string MaxValue, bool Technical)
@@ -348,6 +355,12 @@ namespace settings {
 		(*this)[OPTION_NODES_TIME] = (Option *)(new OptionSpin(OPTION_NODES_TIME, 0, 0, INT_MAX, true));
 		(*this)[OPTION_SYZYGY_PATH] = (Option *)(new OptionString(OPTION_SYZYGY_PATH));
 		(*this)[OPTION_SYZYGY_PROBE_DEPTH] = (Option *)(new OptionSpin(OPTION_SYZYGY_PROBE_DEPTH, parameter.TBProbeDepth, 0, MAX_DEPTH + 1));
+		(*this)[OPTION_EVAL_CACHE] = (Option *)(new OptionSpin(OPTION_EVAL_CACHE, 1, 0, 256));
+		(*this)[OPTION_PAWN_HASH] = (Option *)(new OptionSpin(OPTION_PAWN_HASH, 4, 1, 1024));
+		(*this)[OPTION_SMP_DIVERSIFICATION] = (Option *)(new OptionCheck(OPTION_SMP_DIVERSIFICATION, true, true));
+#ifdef __linux__
+		(*this)[OPTION_NUMA] = (Option *)(new OptionNuma());
+#endif
 	}
 
 	OptionCheck::OptionCheck(std::string Name, bool value, bool Technical)
@@ -392,6 +405,19 @@ namespace settings {
 		else _value = "";
 	}
 
+	void OptionNuma::set(std::string value)
+	{
+		set(!value.compare("true"));
+	}
+
+	void OptionNuma::set(bool value)
+	{
+		if (value == _value) return;
+		_value = value;
+		parameter.UseNuma = value;
+		tt::InitializeTranspositionTable(true); //Reallocate to apply the new memory policy
+	}
+
 	void OptionHash::set(std::string value)
 	{
 		_value = stoi(value);
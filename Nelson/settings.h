@@ -8,8 +8,9 @@
 
 const int PV_MAX_LENGTH = 32; //Maximum Length of displayed Principal Variation
 const int MASK_TIME_CHECK = (1 << 14) - 1; //Time is only checked each MASK_TIME_CHECK nodes
+const int MASK_NODE_CHECK = (1 << 8) - 1; //With a node limit the stop conditions are checked each MASK_NODE_CHECK nodes by every thread
 
-const int PAWN_TABLE_SIZE = 1 << 14; //has to be power of 2
+const int MAX_THREADS = 128; //Maximum number of search threads
 const int KILLER_TABLE_SIZE = 1 << 11; //has to be power of 2
 
 ////Bonus for Passed Pawns (dynamic evaluations)
@@ -34,6 +35,7 @@ namespace settings {
 		int LMRReduction(int depth, int moveNumber);
 
 		int HelperThreads = 0;
+		bool UseNuma = false; //Bind threads to NUMA nodes and interleave the hash table over all nodes (Linux only)
 		Value Contempt = Value(10);
 		Color EngineSide = WHITE;
 		int EmergencyTime = 0;
@@ -247,7 +249,8 @@ namespace settings {
 		void UCIExpose();
 		void SetFromUCI(std::string name, std::string value);
 
-		void setParam(std::string key, std::string value);
+		//Sets a parameter by name. Returns true, if the parameter affects the material table (which then has to be rebuilt)
+		bool setParam(std::string key, std::string value);
 	private:
 		void Initialize();
 		int LMR_REDUCTION[64][64];
@@ -274,6 +277,10 @@ namespace settings {
 	const std::string OPTION_NODES_TIME = "Nodestime"; //Nodes per millisecond
 	const std::string OPTION_SYZYGY_PATH = "SyzygyPath";
 	const std::string OPTION_SYZYGY_PROBE_DEPTH = "SyzygyProbeDepth";
+	const std::string OPTION_NUMA = "NUMA";
+	const std::string OPTION_EVAL_CACHE = "EvalCache"; //Size of the evaluation cache per thread in MB
+	const std::string OPTION_PAWN_HASH = "PawnHash"; //Size of the pawn hash table per thread in MB
+	const std::string OPTION_SMP_DIVERSIFICATION = "SMPDiversification"; //Helper threads skip depths and use different aspiration windows
 
 	class Option {
 	public:
@@ -306,6 +313,8 @@ namespace settings {
 		inline void set(int value) { _value = value; }
 		inline void setDefault(std::string value) { defaultValue = value; }
 		inline void setDefault(int value) { defaultValue = std::to_string(value); }
+		inline int getMin() const { return stoi(minValue); }
+		inline int getMax() const { return stoi(maxValue); }
 		inline int getValue() { 
 			if (_value == INT_MIN) set(defaultValue); 
 			return _value; 
@@ -350,7 +359,7 @@ namespace settings {
 
 	class OptionThread : public OptionSpin {
 	public:
-		OptionThread() : OptionSpin(OPTION_THREADS, parameter.HelperThreads + 1, 1, 128) { };
+		OptionThread() : OptionSpin(OPTION_THREADS, parameter.HelperThreads + 1, 1, MAX_THREADS) { };
 		virtual ~OptionThread() { };
 		void set(std::string value);
 	};
@@ -371,6 +380,14 @@ namespace settings {
 		void set(int value);
 	};
 
+	class OptionNuma : public OptionCheck {
+	public:
+		OptionNuma() : OptionCheck(OPTION_NUMA, parameter.UseNuma) { };
+		virtual ~OptionNuma() { };
+		void set(std::string value);
+		void set(bool value);
+	};
+
 	class OptionHash : public OptionSpin {
 	public:
 		OptionHash() : OptionSpin(OPTION_HASH, 32, 1, 16384) { };
@@ -7,6 +7,7 @@
 #include <string>
 #include <map>
 #include <cstdlib>
+#include <algorithm>
 #include <vector>
 #include "test.h"
 #include "search.h"
@@ -27,6 +28,8 @@ namespace test {
 			<< "\nTotal time (ms) : " << totalTime
 			<< "\nNodes searched  : " << totalNodes
 			<< "\nNodes/second    : " << 1000 * totalNodes / totalTime << std::endl;
+		std::cerr << "\nHash statistics:" << std::endl;
+		tt::printStatistics(std::cerr);
 		return totalNodes;
 	}
 
@@ -45,6 +48,8 @@ namespace test {
 				<< "\nTotal time (ms) : " << runtime
 				<< "\nNodes searched  : " << totalNodes
 				<< "\nNodes/second    : " << 1000 * totalNodes / runtime << std::endl;
+			std::cerr << "\nHash statistics:" << std::endl;
+			tt::printStatistics(std::cerr);
 			return totalNodes;
 		}
 		else return -1;
@@ -424,6 +429,193 @@ namespace test {
 		return bench(benchFens3(), depth, totalTime);
 	}
 
+	void benchmarkHashSizes(int depth, std::vector<int> sizes) {
+		std::vector<std::string> fens = benchFens1();
+		std::vector<std::string> fens2 = benchFens2();
+		fens.insert(fens.end(), fens2.begin(), fens2.end());
+		std::stringstream summary;
+		summary << std::left << std::setw(10) << "Hash[MB]" << std::setw(12) << "Used[MB]" << std::setw(10) << "Time" << std::setw(12) << "Nodes"
+			<< std::setw(10) << "Speed" << std::setw(8) << "TT[%]" << std::endl;
+		for (int size : sizes) {
+			((settings::OptionHash *)settings::options[settings::OPTION_HASH])->set(size);
+			tt::clear();
+			tt::ResetCounter();
+			int64_t runtime = 0;
+			int64_t nodes = bench(fens, depth, runtime);
+			if (runtime == 0) runtime = 1;
+			summary << std::left << std::setw(10) << size << std::setw(12) << std::setprecision(5) << tt::GetClusterCount() * sizeof(tt::Cluster) / 1048576.0
+				<< std::setw(10) << runtime << std::setw(12) << nodes << std::setw(10) << nodes / runtime << std::setw(8) << std::setprecision(4)
+				<< (tt::GetProbeCounter() ? 100.0 * tt::GetHitCounter() / tt::GetProbeCounter() : 0.0) << std::endl;
+		}
+		std::cerr << "\n===========================\n" << summary.str();
+	}
+
+	void benchmarkNuma(int threads, int depth) {
+		((settings::OptionSpin *)settings::options[settings::OPTION_THREADS])->set(threads);
+		settings::parameter.HelperThreads = threads - 1;
+		std::stringstream summary;
+		summary << "Threads: " << threads << "  NUMA nodes: " << numa::nodeCount() << std::endl;
+		summary << std::left << std::setw(8) << "NUMA" << std::setw(10) << "Time" << std::setw(14) << "Nodes" << std::setw(10) << "Speed" << std::endl;
+		for (bool useNuma : { false, true }) {
+			if (settings::options.find(settings::OPTION_NUMA) != settings::options.end())
+				settings::options[settings::OPTION_NUMA]->set(utils::bool2String(useNuma));
+			int64_t runtime = 0;
+			int64_t nodes = bench(depth, runtime);
+			if (runtime == 0) runtime = 1;
+			summary << std::left << std::setw(8) << utils::bool2String(useNuma) << std::setw(10) << runtime << std::setw(14) << nodes << std::setw(10) << nodes / runtime << std::endl;
+		}
+		std::cerr << "\n===========================\n" << summary.str();
+	}
+
+	void benchmarkTimeToDepth(int maxThreads, int depth) {
+		std::stringstream summary;
+		summary << "Time to depth " << depth << std::endl;
+		summary << std::left << std::setw(9) << "Threads" << std::setw(11) << "Diversify" << std::setw(10) << "Time" << std::setw(14) << "Nodes" << std::setw(10) << "Speedup" << std::endl;
+		int64_t singleThreadTime = 1;
+		for (int threads = 1; threads <= maxThreads; threads *= 2) {
+			for (bool diversify : { false, true }) {
+				if (threads == 1 && diversify) continue;
+				((settings::OptionSpin *)settings::options[settings::OPTION_THREADS])->set(threads);
+				settings::parameter.HelperThreads = threads - 1;
+				settings::options[settings::OPTION_SMP_DIVERSIFICATION]->set(utils::bool2String(diversify));
+				tt::clear();
+				tt::ResetCounter();
+				int64_t runtime = 0;
+				int64_t nodes = bench(depth, runtime);
+				if (runtime == 0) runtime = 1;
+				if (threads == 1) singleThreadTime = runtime;
+				summary << std::left << std::setw(9) << threads << std::setw(11) << utils::bool2String(diversify) << std::setw(10) << runtime << std::setw(14) << nodes
+					<< std::setw(10) << std::setprecision(3) << double(singleThreadTime) / runtime << std::endl;
+			}
+		}
+		std::cerr << "\n===========================\n" << summary.str();
+	}
+
+	void benchmarkReplacementPolicy(int depth) {
+		std::vector<std::string> fens = benchFens1();
+		std::vector<std::string> fens2 = benchFens2();
+		fens.insert(fens.end(), fens2.begin(), fens2.end());
+		tt::clear();
+		tt::ResetCounter();
+		int64_t runtime = 0;
+		int64_t nodes = bench(fens, depth, runtime);
+		if (runtime == 0) runtime = 1;
+		tt::Statistics stats = tt::GetStatistics();
+		std::stringstream summary;
+		summary << "Hash: " << settings::options.getInt(settings::OPTION_HASH) << " MB" << std::endl;
+		summary << std::left << std::setw(16) << "Policy" << std::setw(10) << "Time" << std::setw(12) << "Nodes" << std::setw(10) << "Speed"
+			<< std::setw(8) << "TT[%]" << std::setw(12) << "Repl(Age)" << std::setw(12) << "Repl(Depth)" << std::endl;
+		summary << std::left << std::setw(16) << tt::ReplacementPolicy::name() << std::setw(10) << runtime << std::setw(12) << nodes << std::setw(10) << nodes / runtime
+			<< std::setw(8) << std::setprecision(4) << (stats.probes ? 100.0 * stats.hits / stats.probes : 0.0)
+			<< std::setw(12) << stats.replacementsAge << std::setw(12) << stats.replacementsDepth << std::endl;
+		std::cerr << "\n===========================\n" << summary.str();
+	}
+
+	//Occupancy and slider bitboards of a position as used by Position::calculateAttacks
+	struct SliderSample {
+		Bitboard occupied;
+		Bitboard rookSliders;
+		Bitboard bishopSliders;
+	};
+
+	//Slider part of Position::calculateAttacks for one attack lookup scheme. If pressure is not empty, every position is followed
+	//by some random reads from the pressure buffer simulating the hash table probes competing for the cache during search
+	template<Bitboard(*ROOK_TARGETS)(Square, Bitboard), Bitboard(*BISHOP_TARGETS)(Square, Bitboard)>
+	Bitboard sliderAttacks(const std::vector<SliderSample>& samples, int iterations, const std::vector<uint64_t>& pressure) {
+		Bitboard result = 0;
+		uint64_t rnd = 0x9E3779B97F4A7C15ull;
+		for (int i = 0; i < iterations; ++i) {
+			for (const SliderSample& sample : samples) {
+				Bitboard rookSliders = sample.rookSliders;
+				while (rookSliders) {
+					result ^= ROOK_TARGETS(lsb(rookSliders), sample.occupied);
+					rookSliders &= rookSliders - 1;
+				}
+				Bitboard bishopSliders = sample.bishopSliders;
+				while (bishopSliders) {
+					result ^= BISHOP_TARGETS(lsb(bishopSliders), sample.occupied);
+					bishopSliders &= bishopSliders - 1;
+				}
+				if (!pressure.empty()) {
+					for (int p = 0; p < 4; ++p) {
+						rnd ^= rnd << 13; rnd ^= rnd >> 7; rnd ^= rnd << 17;
+						result += pressure[rnd % pressure.size()];
+					}
+				}
+			}
+		}
+		return result;
+	}
+
+	struct SliderScheme {
+		std::string name;
+		size_t footprint;
+		Bitboard(*rookTargets)(Square, Bitboard);
+		Bitboard(*bishopTargets)(Square, Bitboard);
+		Bitboard(*run)(const std::vector<SliderSample>&, int, const std::vector<uint64_t>&);
+	};
+
+	void benchmarkSliderAttacks(int iterations) {
+		std::vector<SliderScheme> schemes;
+#ifndef USE_PEXT
+		InitializeMagic();
+		schemes.push_back({ "magic", sizeof(MagicMovesRook) + sizeof(MagicMovesBishop) + 2 * (sizeof(OccupancyMaskRook) + sizeof(RookMagics) + sizeof(RookShift) + sizeof(IndexOffsetRook)),
+			RookTargetsMagic, BishopTargetsMagic, sliderAttacks<RookTargetsMagic, BishopTargetsMagic> });
+#endif
+#if defined(USE_PEXT) || defined(PEXT_DISPATCH)
+		if (HardwarePext) {
+			initializePext();
+			schemes.push_back({ "pext", sizeof(ATTACKS) + 2 * (sizeof(ROOK_MASKS) + sizeof(ROOK_OFFSETS)), RookTargetsPext, BishopTargetsPext, sliderAttacks<RookTargetsPext, BishopTargetsPext> });
+		}
+#endif
+		InitializeCompactSliders();
+		schemes.push_back({ "compact", sizeof(FillUpAttacks) + sizeof(AFileAttacks) + sizeof(RankMaskEx) + sizeof(DiagonalMaskEx) + sizeof(AntiDiagonalMaskEx),
+			RookTargetsCompact, BishopTargetsCompact, sliderAttacks<RookTargetsCompact, BishopTargetsCompact> });
+
+		std::vector<std::string> fens = benchFens1();
+		std::vector<std::string> fens2 = benchFens2();
+		fens.insert(fens.end(), fens2.begin(), fens2.end());
+		std::vector<SliderSample> samples;
+		int64_t lookups = 0;
+		for (const std::string& fen : fens) {
+			Position pos(fen);
+			SliderSample sample = { pos.OccupiedBB(), pos.PieceTypeBB(ROOK) | pos.PieceTypeBB(QUEEN), pos.PieceTypeBB(BISHOP) | pos.PieceTypeBB(QUEEN) };
+			samples.push_back(sample);
+			lookups += popcount(sample.rookSliders) + popcount(sample.bishopSliders);
+		}
+		lookups *= iterations;
+
+		//All schemes have to agree with the first one for all squares and sample occupancies
+		int errors = 0;
+		for (const SliderSample& sample : samples) {
+			for (int square = 0; square < 64; ++square) {
+				Bitboard occupied = sample.occupied & ~ToBitboard(square);
+				for (const SliderScheme& scheme : schemes) {
+					if (scheme.rookTargets(Square(square), occupied) != schemes[0].rookTargets(Square(square), occupied)
+						|| scheme.bishopTargets(Square(square), occupied) != schemes[0].bishopTargets(Square(square), occupied)) ++errors;
+				}
+			}
+		}
+
+		std::vector<uint64_t> noPressure;
+		std::vector<uint64_t> pressure(2 * 1024 * 1024, 1); //16 MB
+		std::stringstream summary;
+		summary << "Positions: " << samples.size() << "  Iterations: " << iterations << "  Verification: " << (errors ? "ERROR" : "OK") << std::endl;
+		summary << std::left << std::setw(10) << "Scheme" << std::setw(14) << "Tables[KB]" << std::setw(16) << "MLookups/s" << std::setw(24) << "MLookups/s (16 MB load)" << std::endl;
+		Bitboard sink = 0;
+		for (const SliderScheme& scheme : schemes) {
+			summary << std::left << std::setw(10) << scheme.name << std::setw(14) << std::setprecision(4) << scheme.footprint / 1024.0;
+			for (const std::vector<uint64_t>* load : { &noPressure, &pressure }) {
+				auto begin = std::chrono::steady_clock::now();
+				sink ^= scheme.run(samples, iterations, *load);
+				int64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+				summary << std::setw(load == &noPressure ? 16 : 24) << std::setprecision(4) << (micros ? double(lookups) / micros : 0.0);
+			}
+			summary << std::endl;
+		}
+		std::cerr << "\n===========================\n" << summary.str() << "(checksum " << sink << ")" << std::endl;
+	}
+
 	int64_t bench(std::vector<std::string> fens, int depth, int64_t &totalTime) {
 		std::cout << "Benchmark" << std::endl;
 		std::cout << "------------------------------------------------------------------------" << std::endl;
@@ -431,8 +623,10 @@ namespace test {
 		int64_t totalQNodes = 0;
 		totalTime = 0;
 		double avgBF = 0.0;
-		std::cout << std::setprecision(3) << std::left << std::setw(4) << "Nr" << std::setw(7) << "Time" << std::setw(10) << "Nodes" << std::setw(6) << "Speed" << std::setw(6) << "BF" << std::setw(6) << "TT[%]"
+		std::cout << std::setprecision(3) << std::left << std::setw(4) << "Nr" << std::setw(7) << "Time" << std::setw(10) << "Nodes" << std::setw(6) << "Speed" << std::setw(6) << "BF" << std::setw(6) << "TT[%]" << std::setw(6) << "EC[%]"
 			<< std::setw(40) << "PV" << std::endl;
+		uint64_t evalCacheProbes = 0;
+		uint64_t evalCacheHits = 0;
 		Search * srch = new Search;
 		for (int i = 0; i < int(fens.size()); i++) {
 			Position* pos = new Position(fens[i]);
@@ -443,30 +637,36 @@ namespace test {
 			srch->Think(*pos);
 			int64_t endTime = now();
 			totalTime += endTime - srch->timeManager.GetStartTime();
-			srch->NodeCount *= settings::parameter.HelperThreads + 1;
-			srch->QNodeCount *= settings::parameter.HelperThreads + 1;
-			totalNodes += srch->NodeCount;
-			totalQNodes += srch->QNodeCount;
-			avgBF += srch->timeManager.GetEBF(depth) * (srch->NodeCount - srch->QNodeCount);
+			const int64_t nodeCount = srch->NodeCount();
+			const int64_t qnodeCount = srch->QNodeCount();
+			totalNodes += nodeCount;
+			totalQNodes += qnodeCount;
+			avgBF += srch->timeManager.GetEBF(depth) * (nodeCount - qnodeCount);
 			int64_t runtime = endTime - srch->timeManager.GetStartTime();
 			int64_t rt = runtime;
 			if (rt == 0) rt = 1;
-			std::cout << std::left << std::setw(4) << i << std::setw(7) << runtime << std::setw(10) << srch->NodeCount << std::setw(6)
-				<< srch->NodeCount / rt << std::setw(6) << srch->timeManager.GetEBF(depth) << std::setw(6) << (settings::parameter.HelperThreads ? 0 : 100.0 * tt::GetHitCounter() / tt::GetProbeCounter())
+			std::cout << std::left << std::setw(4) << i << std::setw(7) << runtime << std::setw(10) << nodeCount << std::setw(6)
+				<< nodeCount / rt << std::setw(6) << srch->timeManager.GetEBF(depth) << std::setw(6) << 100.0 * tt::GetHitCounter() / tt::GetProbeCounter()
+				<< std::setw(6) << 100.0 * srch->EvalCache().GetHitCounter() / std::max(uint64_t(1), srch->EvalCache().GetProbeCounter())
 				<< std::setw(40) << srch->PrincipalVariation(*pos, depth) << std::endl;
+			evalCacheProbes += srch->EvalCache().GetProbeCounter();
+			evalCacheHits += srch->EvalCache().GetHitCounter();
 			delete(pos);
 		}
 		delete(srch);
 		avgBF = avgBF / (totalNodes - totalQNodes);
 		std::cout << "------------------------------------------------------------------------" << std::endl;
 		std::cout << std::setprecision(5) << "Total:  Time: " << totalTime / 1000.0 << " s  Nodes: " << totalNodes / 1000000.0 << " - " << totalQNodes / 1000000.0 << " MNodes  Speed: " << totalNodes / totalTime << " kN/s  "
-			"BF: " << std::setprecision(3) << avgBF << std::endl;
+			"BF: " << std::setprecision(3) << avgBF << "  Eval Cache Hits: " << 100.0 * evalCacheHits / std::max(uint64_t(1), evalCacheProbes) << "%" << std::endl;
 
 		return totalNodes;
 	}
 
 
+
 	uint64_t nodeCount = 0;
+	//Number of moves, where isLegal and the legality check done when applying the move disagree
+	uint64_t legalityMismatches = 0;
 
 	uint64_t perft(Position &pos, int depth) {
 		nodeCount++;
@@ -475,8 +675,16 @@ namespace test {
 		uint64_t result = 0;
 		ValuatedMove * moves = pos.GenerateMoves<ALL>();
 		while ((move = *moves).move) {
+			const bool legal = pos.isLegal(move.move);
+#ifdef MAKE_UNMAKE
+			if (pos.DoMove(move.move) != legal) ++legalityMismatches;
+			if (legal) result += perft(pos, depth - 1);
+			pos.UndoMove(move.move);
+#else
 			Position next(pos);
-			if (next.ApplyMove(move.move)) result += perft(next, depth - 1);
+			if (next.ApplyMove(move.move) != legal) ++legalityMismatches;
+			if (legal) result += perft(next, depth - 1);
+#endif
 			++moves;
 		}
 		return result;
@@ -541,10 +749,16 @@ namespace test {
 		pos.InitializeMoveIterator<MAIN_SEARCH>(nullptr, nullptr, nullptr, nullptr, MOVE_NONE);
 		Move move;
 		while ((move = pos.NextMove())) {
+			const bool legal = pos.isLegal(move);
+#ifdef MAKE_UNMAKE
+			if (pos.DoMove(move) != legal) ++legalityMismatches;
+			if (legal) result += perft3(pos, depth - 1);
+			pos.UndoMove(move);
+#else
 			Position next(pos);
-			if (next.ApplyMove(move)) {
-				result += perft3(next, depth - 1);
-			}
+			if (next.ApplyMove(move) != legal) ++legalityMismatches;
+			if (legal) result += perft3(next, depth - 1);
+#endif
 		}
 		return result;
 	}
@@ -639,6 +853,75 @@ namespace test {
 		delete engine;
 	}
 
+	//Applies the moves given in coordinate notation (a null move is given as "0000")
+	void applyMoves(Position & pos, std::vector<std::string> moves) {
+		for (const std::string & move : moves) {
+			if (!move.compare("0000")) pos.NullMove();
+			else {
+				Position next(pos);
+				next.ApplyMove(parseMoveInUCINotation(move, pos));
+				//repetition detection uses the thread's hash history, so the ancestors aren't needed
+				pos = next;
+				pos.SetPrevious(nullptr);
+			}
+		}
+	}
+
+	bool testUpcomingRepetition() {
+		bool result = true;
+		//Cuckoo tables have to contain all reversible moves on an empty board
+		int cuckooCount = 0;
+		for (int i = 0; i < CUCKOO_SIZE; ++i) cuckooCount += CuckooMoves[i] != MOVE_NONE;
+		result = result && cuckooCount == 3668;
+		//Black can repeat the start position by Nf6-g8 (within the search, before the root only 3-fold repetitions count)
+		Position pos;
+		applyMoves(pos, { "g1f3", "g8f6", "f3g1" });
+		result = result && pos.hasUpcomingRepetition(4) && !pos.hasUpcomingRepetition(3);
+		//Ra1-a8 is blocked by the bishop, which has returned to a5
+		pos.setFromFEN("r6k/8/8/B7/8/8/7K/8 w - - 0 1");
+		applyMoves(pos, { "a5b6", "a8a1", "b6a5" });
+		result = result && !pos.hasUpcomingRepetition(10);
+		//Within the plies after a null move repetitions are detected
+		pos.setFromFEN("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+		applyMoves(pos, { "g1f3", "0000", "b1c3", "b8c6", "c3b1" });
+		result = result && pos.hasUpcomingRepetition(10);
+		//but not across null moves: black can't go back to the start position, although the keys differ only by Nb1-c3 and side to move
+		pos.setFromFEN("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+		applyMoves(pos, { "g1f3", "0000", "f3g1", "0000", "b1c3" });
+		result = result && !pos.hasUpcomingRepetition(10) && !pos.checkRepetition();
+		std::cout << (result ? "OK     " : "ERROR  ") << "Upcoming repetition" << std::endl;
+		return result;
+	}
+
+	void testPonderHitLatency(int iterations) {
+		iterations = std::max(iterations, 1);
+		Position pos;
+		//A book move would return before the search, which sets the Stop flag
+		settings::options[settings::OPTION_OWN_BOOK]->set(utils::bool2String(false));
+		Search * engine = new Search;
+		std::vector<double> latencies;
+		for (int i = 0; i < iterations; ++i) {
+			engine->NewGame();
+			engine->timeManager.initialize(FIXED_DEPTH, 0, 5);
+			engine->PonderMode.store(true);
+			engine->Stop.store(false);
+			std::chrono::steady_clock::time_point returned;
+			std::thread thinker([&] { engine->Think(pos); returned = std::chrono::steady_clock::now(); });
+			//Think sets Stop after the search has completed, just before it waits for the ponderhit
+			while (!engine->Stop.load()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			std::chrono::steady_clock::time_point hit = std::chrono::steady_clock::now();
+			engine->StopPondering();
+			thinker.join();
+			latencies.push_back(std::chrono::duration<double, std::micro>(returned - hit).count());
+		}
+		delete engine;
+		std::sort(latencies.begin(), latencies.end());
+		double total = 0;
+		for (double latency : latencies) total += latency;
+		std::cout << std::fixed << std::setprecision(1) << "Ponderhit latency (" << iterations << " runs): Avg: " << total / iterations
+			<< " us  Median: " << latencies[iterations / 2] << " us  Max: " << latencies.back() << " us" << std::endl;
+	}
+
 	void testFindMate() {
 		std::map<std::string, Move> puzzles;
 		//Mate in 2
@@ -1165,6 +1448,7 @@ namespace test {
 	int64_t perftRuntime;
 	bool checkPerft(std::string fen, int depth, uint64_t expectedResult, PerftType perftType = BASIC) {
 		testCount++;
+		legalityMismatches = 0;
 		Position pos(fen);
 		uint64_t perftResult;
 		int64_t begin = now();
@@ -1184,6 +1468,10 @@ namespace test {
 		int64_t runtime = end - begin;
 		perftRuntime += runtime;
 		perftNodes += expectedResult;
+		if (legalityMismatches > 0) {
+			std::cout << testCount << "\t" << "Error\t" << depth << "\t" << legalityMismatches << " moves where isLegal disagrees with applying the move\t" << fen << std::endl;
+			return false;
+		}
 		if (perftResult == expectedResult) {
 			if (runtime > 0) {
 				std::cout << testCount << "\t" << "OK\t" << depth << "\t" << perftResult << "\t" << runtime << " ms\t" << expectedResult / runtime << " kNodes/s\t" << std::endl << "\t" << fen << std::endl;
@@ -16,6 +16,17 @@ namespace test {
 
 	int64_t benchmark(int depth);
 	int64_t benchmark(std::string filename, int depth);
+	//runs the benchmark with different hash sizes (in MB) and compares the TT hit rates
+	void benchmarkHashSizes(int depth, std::vector<int> sizes);
+	//runs the benchmark with the given number of threads with and without NUMA mode
+	void benchmarkNuma(int threads, int depth);
+	//measures the time to reach the given depth for 1, 2, 4, ... maxThreads threads with and without helper diversification
+	void benchmarkTimeToDepth(int maxThreads, int depth);
+	//runs the benchmark with the hash replacement policy the engine has been built with and reports time, nodes and hit rate
+	//(the Makefile's policies target builds an engine for each policy)
+	void benchmarkReplacementPolicy(int depth);
+	//compares throughput and table size of the slider attack lookup schemes (magic, pext, compact)
+	void benchmarkSliderAttacks(int iterations);
 	int64_t bench(std::vector<std::string> fens, int depth, int64_t &totalTime);
 	int64_t bench(int depth, int64_t &totalTime); //Benchmark positions from SF
 	int64_t bench2(int depth, int64_t &totalTime); //100 Random positions from GM games
@@ -40,6 +51,10 @@ namespace test {
 	void testFindMate();
 	void testResult();
 	void testRepetition();
+	//checks the cuckoo tables and Position::hasUpcomingRepetition (incl. null moves)
+	bool testUpcomingRepetition();
+	//measures the time from ponderhit until a finished ponder search returns its best move
+	void testPonderHitLatency(int iterations);
 	void testKPK();
 	bool testBBOperations();
 	bool testPopcount();
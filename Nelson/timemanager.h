@@ -48,6 +48,8 @@ enum TimeMode  { UNDEF,                   //Not yet defined
 		inline Time_t GetStartTime() const { return _starttime; }
 		//Returns the depth at which search will be stopped
 		inline int GetMaxDepth() const { return _maxDepth; }
+		//Returns the node count at which search will be stopped (INT64_MAX if there is no node limit)
+		inline int64_t GetMaxNodes() const { return _maxNodes; }
 		//Informs the timemanager that a fail low at root has happened - timemanager will assign more time
 		inline void reportFailLow() { _failLowDepth = _completedDepth + 1; }
 		//Utility method: returns a string, with the current time values to store it in a log
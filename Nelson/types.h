@@ -20,6 +20,26 @@
 #define NO_POPCOUNT 1
 #endif
 
+//Unless the build targets a specific instruction set (-DUSE_PEXT, -mpopcnt, -march=native) the x64 binary contains
+//both hardware and fallback implementations for popcount and slider attacks. The implementation is chosen at startup
+//based on CPUID (see HardwarePopcount and HardwarePext)
+#if (defined(__GNUC__) && defined(__x86_64__)) || (defined(_MSC_VER) && defined(_M_X64) && !defined(__clang__))
+#ifndef USE_PEXT
+#define PEXT_DISPATCH
+#endif
+#endif
+//Popcount isn't dispatched per call: the evaluation, which does nearly all of the popcounts, is compiled a 2nd time
+//for the POPCNT instruction and selected once at startup (see InitializeEvaluation)
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(NO_POPCOUNT) && !defined(__POPCNT__)
+#define POPCOUNT_DISPATCH
+#define TARGET_POPCNT __attribute__((target("popcnt")))
+#endif
+
+//true if popcount is done by the POPCNT instruction
+extern bool HardwarePopcount;
+//true if slider attacks are looked up using the PEXT instruction
+extern bool HardwarePext;
+
 #ifdef _MSC_VER
 #ifdef _WIN64
 #pragma intrinsic(_BitScanForward64)
@@ -203,15 +223,17 @@ const uint64_t EPAttackersForToField[] = { 0x2000000ull,
 inline uint64_t GetEPAttackersForToField(Square to) { return EPAttackersForToField[to - A4]; }
 inline uint64_t GetEPAttackersForToField(int to) { return EPAttackersForToField[to - A4]; }
 
-#ifdef _MSC_VER
-#ifdef _WIN64
-#ifdef NO_POPCOUNT
-inline int popcount(Bitboard bb) {
+inline int popcountSoftware(Bitboard bb) {
 	bb -= (bb >> 1) & 0x5555555555555555ULL;
 	bb = ((bb >> 2) & 0x3333333333333333ULL) + (bb & 0x3333333333333333ULL);
 	bb = ((bb >> 4) + bb) & 0x0F0F0F0F0F0F0F0FULL;
 	return (bb * 0x0101010101010101ULL) >> 56;
 }
+
+#ifdef _MSC_VER
+#ifdef _WIN64
+#ifdef NO_POPCOUNT
+inline int popcount(Bitboard bb) { return popcountSoftware(bb); }
 #else
 #ifdef __clang__
 inline int popcount(Bitboard bb) { return __builtin_popcountll(bb); }
@@ -220,12 +242,7 @@ inline int popcount(Bitboard bb) { return (int)_mm_popcnt_u64(bb); }
 #endif
 #endif
 #else
-inline int popcount(Bitboard bb) {
-	bb -= (bb >> 1) & 0x5555555555555555ULL;
-	bb = ((bb >> 2) & 0x3333333333333333ULL) + (bb & 0x3333333333333333ULL);
-	bb = ((bb >> 4) + bb) & 0x0F0F0F0F0F0F0F0FULL;
-	return (bb * 0x0101010101010101ULL) >> 56;
-}
+inline int popcount(Bitboard bb) { return popcountSoftware(bb); }
 #endif
 
 inline Square lsb(Bitboard bb) {
@@ -274,14 +291,10 @@ inline Square msb(Bitboard b) {
 #endif
 
 #ifdef __GNUC__
-#ifdef NO_POPCOUNT
-inline int popcount(Bitboard bb) {
-	bb -= (bb >> 1) & 0x5555555555555555ULL;
-	bb = ((bb >> 2) & 0x3333333333333333ULL) + (bb & 0x3333333333333333ULL);
-	bb = ((bb >> 4) + bb) & 0x0F0F0F0F0F0F0F0FULL;
-	return (bb * 0x0101010101010101ULL) >> 56;
-}
+#if defined(NO_POPCOUNT)
+inline int popcount(Bitboard bb) { return popcountSoftware(bb); }
 #else
+//Compiles to the POPCNT instruction with -mpopcnt or within TARGET_POPCNT functions, to a libgcc call otherwise
 inline int popcount(Bitboard bb) { return __builtin_popcountll(bb); }
 #endif
 
@@ -301,6 +314,22 @@ inline Square pop_lsb(Bitboard* bb) {
 	return s;
 }
 
+//returns the upper 64 bits of the 128 bit product a * b
+inline uint64_t mul_hi64(uint64_t a, uint64_t b) {
+#if defined(__GNUC__) && defined(__SIZEOF_INT128__)
+	return static_cast<uint64_t>((static_cast<unsigned __int128>(a) * b) >> 64);
+#elif defined(_MSC_VER) && defined(_WIN64) && !defined(_M_ARM64)
+	return __umulh(a, b);
+#else
+	uint64_t aL = uint32_t(a), aH = a >> 32;
+	uint64_t bL = uint32_t(b), bH = b >> 32;
+	uint64_t c1 = (aL * bL) >> 32;
+	uint64_t c2 = aH * bL + c1;
+	uint64_t c3 = aL * bH + uint32_t(c2);
+	return aH * bH + (c2 >> 32) + (c3 >> 32);
+#endif
+}
+
 //inline Square lsb(Bitboard bb) { return Square(popcount((bb & (0 - bb)) - 1)); }
 
 inline Square frontmostSquare(Color c, Bitboard b) { return c == WHITE ? msb(b) : lsb(b); }
@@ -320,10 +349,7 @@ struct Eval {
 		egScore = egValue;
 	}
 
-	Eval(int mgValue, int egValue) {
-		mgScore = Value(mgValue);
-		egScore = Value(egValue);
-	}
+	constexpr Eval(int mgValue, int egValue) : mgScore(Value(mgValue)), egScore(Value(egValue)) { }
 
 	explicit Eval(int value) {
 		mgScore = Value(value);
@@ -439,11 +465,18 @@ inline Time_t now() {
 }
 #endif
 
-#ifdef USE_PEXT 
+#if defined(USE_PEXT) || (defined(PEXT_DISPATCH) && (defined(__BMI2__) || defined(_MSC_VER)))
 #include <immintrin.h> // Header for _pext_u64() intrinsic
 inline Bitboard pext(Bitboard val, Bitboard mask) {
 	return _pext_u64(val, mask);
 }
+#elif defined(PEXT_DISPATCH)
+//Compiled without BMI2 support => emit the instruction directly, must only be executed if HardwarePext is set
+inline Bitboard pext(Bitboard val, Bitboard mask) {
+	Bitboard result;
+	__asm__("pextq %2, %1, %0" : "=r" (result) : "r" (val), "r" (mask));
+	return result;
+}
 #else
 inline Bitboard pext(Bitboard val, Bitboard mask) {
 	Bitboard res = 0;
@@ -81,6 +81,15 @@ bool UCIInterface::dispatch(std::string line) {
 	else if (!command.compare("dumpTT")) {
 		dumpTT(tokens);
 	}
+	else if (!command.compare("ttstats")) {
+		tt::printStatistics(std::cout);
+	}
+	else if (!command.compare("saveTT")) {
+		saveTT(tokens);
+	}
+	else if (!command.compare("loadTT")) {
+		loadTT(tokens);
+	}
 	//else if (!strcmp(token, "eval"))
 	//	cout << printEvaluation(pos);
 	//else if (!strcmp(token, "qeval"))
@@ -95,15 +104,7 @@ bool UCIInterface::dispatch(std::string line) {
 void UCIInterface::uci() {
 	main_thread = std::thread{ &UCIInterface::thinkAsync, this };
 	Engine->UciOutput = true;
-#ifdef NO_POPCOUNT
-	sync_cout << "id name " << VERSION_INFO << " (No Popcount)" << sync_endl;
-#else
-#ifdef PEXT
-	sync_cout << "id name " << VERSION_INFO << " (BMI2)" << sync_endl;
-#else
-	sync_cout << "id name " << VERSION_INFO << sync_endl;
-#endif
-#endif
+	sync_cout << "id name " << VERSION_INFO << (HardwarePext ? " (BMI2)" : HardwarePopcount ? "" : " (No Popcount)") << sync_endl;
 	sync_cout << "id author Christian Guenther" << sync_endl;
 	//read ini file (if exists)
 	std::ifstream inifile("nemorino.ini");
@@ -230,7 +231,12 @@ void UCIInterface::setPosition(std::vector<std::string> &tokens) {
 			++idx;
 		}
 		std::string fen = ssFen.str().substr(1);
-		startpos = new Position(fen);
+		startpos = new Position();
+		if (!startpos->setFromFEN(fen)) {
+			//the moves can't be applied to the start position, which is used instead
+			utils::debugInfo("Invalid FEN (start position is used instead):", fen);
+			idx = (unsigned int)tokens.size();
+		}
 	}
 	if (startpos) {
 		Position * pp = startpos;
@@ -239,7 +245,6 @@ void UCIInterface::setPosition(std::vector<std::string> &tokens) {
 			while (idx < tokens.size()) {
 				Position * next = new Position(*pp);
 				next->ApplyMove(parseMoveInUCINotation(tokens[idx], *next));
-				next->AppliedMovesBeforeRoot++;
 				pp = next;
 				++idx;
 			}
@@ -250,7 +255,6 @@ void UCIInterface::setPosition(std::vector<std::string> &tokens) {
 }
 
 void UCIInterface::deleteThread() {
-	Engine->PonderMode.store(false);
 	Engine->StopThinking();
 	Engine->Reset();
 	{
@@ -298,7 +302,6 @@ void UCIInterface::qscore(std::vector<std::string>& tokens)
 //}
 
 void UCIInterface::thinkAsync() {
-	bool first = true;
 	while (true) {
 		std::unique_lock<std::mutex> lock(mtxEngineRunning);
 		cvStartEngine.wait(lock, [=] { return exiting.load() || engine_active.load(); });
@@ -308,9 +311,8 @@ void UCIInterface::thinkAsync() {
 		}
 		ValuatedMove BestMove;
 		if (Engine == NULL) return;
-		if (first && settings::parameter.HelperThreads > 0)
-			WinProcGroup::bindThisThread(0);
-		first = false;
+		//Binding is done before each search, as the NUMA option might have been changed since the last one
+		WinProcGroup::bindThisThread(0);
 		BestMove = Engine->Think(*_position);
 		if (!ponderActive) sync_cout << "bestmove " << toString(BestMove.move) << sync_endl;
 		else {
@@ -413,7 +415,7 @@ void UCIInterface::go(std::vector<std::string> &tokens) {
 }
 
 void UCIInterface::ponderhit() {
-	Engine->PonderMode.store(false);
+	Engine->StopPondering();
 	Engine->timeManager.PonderHit();
 }
 
@@ -425,8 +427,7 @@ void UCIInterface::setvalue(std::vector<std::string> &tokens) {
 
 void UCIInterface::stop() {
 	utils::debugInfo("Trying to stop...");
-	Engine->Stop.store(true);
-	Engine->PonderMode.store(false);
+	Engine->StopThinking();
 }
 
 void UCIInterface::perft(std::vector<std::string> &tokens) {
@@ -489,13 +490,40 @@ void UCIInterface::dumpTT(std::vector<std::string>& tokens)
 	else filename = tokens[1];
 	std::ofstream of;
 	of.open(filename, std::ios::binary | std::ios::out);
+	//Header: the zero-padded fen (96 bytes) followed by the cluster count (uint64_t), which isn't a power of 2 in general
 	std::string fen = _position->fen();
-	size_t len = fen.length();
-	char * fena = new char[96];
-	for (size_t i = len; i < 96; ++i) fena[i] = 0x00;
-	fena[95] = (char)popcount(tt::GetClusterCount() - 1);
-	strcpy(fena, fen.c_str());
-	of.write(fena, 96);
+	char fena[96] = { 0 };
+	fen.copy(fena, sizeof(fena) - 1);
+	of.write(fena, sizeof(fena));
+	const uint64_t clusterCount = tt::GetClusterCount();
+	of.write(reinterpret_cast<const char *>(&clusterCount), sizeof(clusterCount));
 	tt::dumpTT(of);
 	of.close();
 }
+
+void UCIInterface::saveTT(std::vector<std::string>& tokens)
+{
+	std::string filename = tokens.size() < 2 ? "snapshot.tt" : tokens[1];
+	//While a search is running the table is modified concurrently, so that the snapshot would be inconsistent
+	std::unique_lock<std::mutex> lock(Engine->mtxSearch, std::try_to_lock);
+	if (!lock.owns_lock()) {
+		utils::debugInfo("Hash snapshot can't be saved while engine is thinking");
+		return;
+	}
+	if (tt::saveSnapshot(filename)) utils::debugInfo("Hash snapshot saved to", filename);
+	else utils::debugInfo("Hash snapshot couldn't be saved to", filename);
+}
+
+void UCIInterface::loadTT(std::vector<std::string>& tokens)
+{
+	std::string filename = tokens.size() < 2 ? "snapshot.tt" : tokens[1];
+	//The table must not be replaced while a search is accessing it (Think holds the search mutex until the search has finished)
+	std::unique_lock<std::mutex> lock(Engine->mtxSearch, std::try_to_lock);
+	if (!lock.owns_lock()) {
+		utils::debugInfo("Hash snapshot can't be loaded while engine is thinking");
+		return;
+	}
+	std::string message;
+	tt::loadSnapshot(filename, message);
+	utils::debugInfo(message);
+}
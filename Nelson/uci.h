@@ -44,6 +44,8 @@ private:
 	void see(std::vector<std::string> &tokens);
 	void qscore(std::vector<std::string> &tokens);
 	void dumpTT(std::vector<std::string> &tokens);
+	void saveTT(std::vector<std::string> &tokens);
+	void loadTT(std::vector<std::string> &tokens);
 	void updateFromOptions();
 	void copySettings(Search * source, Search * destination);
 };
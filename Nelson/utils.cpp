@@ -13,6 +13,14 @@
 #include "search.h"
 #include "utils.h"
 
+#ifdef __linux__
+#include <dirent.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
 #ifdef _WIN32
 #if _WIN32_WINNT < 0x0601
 #undef  _WIN32_WINNT
@@ -53,11 +61,109 @@ std::ostream& operator<<(std::ostream& os, SyncCout sc) {
 	return os;
 }
 
+namespace numa {
+
+#ifdef __linux__
+
+	struct Node {
+		int id;
+		std::vector<int> cpus;
+	};
+
+	//parses cpu lists like "0-15,32-47"
+	std::vector<int> parseCpuList(const std::string & list) {
+		std::vector<int> cpus;
+		for (const std::string & range : utils::split(utils::Trim(list), ',')) {
+			size_t dash = range.find('-');
+			int first = std::atoi(range.substr(0, dash).c_str());
+			int last = dash == std::string::npos ? first : std::atoi(range.substr(dash + 1).c_str());
+			for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+		}
+		return cpus;
+	}
+
+	std::vector<Node> readNodes() {
+		std::vector<Node> nodes;
+		DIR * dir = opendir("/sys/devices/system/node");
+		if (dir == nullptr) return nodes;
+		while (dirent * entry = readdir(dir)) {
+			std::string name(entry->d_name);
+			if (name.compare(0, 4, "node") || name.length() < 5 || !isdigit(name[4])) continue;
+			std::ifstream cpulist("/sys/devices/system/node/" + name + "/cpulist");
+			std::string list;
+			if (!std::getline(cpulist, list)) continue;
+			Node node;
+			node.id = std::atoi(name.substr(4).c_str());
+			node.cpus = parseCpuList(list);
+			if (node.cpus.size() > 0) nodes.push_back(node);
+		}
+		closedir(dir);
+		std::sort(nodes.begin(), nodes.end(), [](const Node & n1, const Node & n2) { return n1.id < n2.id; });
+		return nodes;
+	}
+
+	const std::vector<Node> & nodes() {
+		static const std::vector<Node> nodeList = readNodes();
+		return nodeList;
+	}
+
+	int nodeCount() { return std::max(1, int(nodes().size())); }
+
+	//Affinity of the process at startup (read during static initialization, i.e. before any thread has been bound)
+	cpu_set_t readAffinity() {
+		cpu_set_t cpuSet;
+		CPU_ZERO(&cpuSet);
+		sched_getaffinity(0, sizeof(cpu_set_t), &cpuSet);
+		return cpuSet;
+	}
+	const cpu_set_t originalAffinity = readAffinity();
+
+	//Node the current thread is bound to (-1 if it isn't bound)
+	thread_local int boundNode = -1;
+
+	void bindThisThread(size_t idx) {
+		if (!settings::parameter.UseNuma || nodeCount() < 2) {
+			//NUMA mode has been switched off since the thread has been bound => give it back the original affinity
+			if (boundNode >= 0) pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &originalAffinity);
+			boundNode = -1;
+			return;
+		}
+		const Node & node = nodes()[idx % nodes().size()];
+		if (node.id == boundNode) return;
+		cpu_set_t cpuSet;
+		CPU_ZERO(&cpuSet);
+		for (int cpu : node.cpus) CPU_SET(cpu, &cpuSet);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet);
+		boundNode = node.id;
+	}
+
+	bool interleave(void * memory, size_t size) {
+		if (!settings::parameter.UseNuma || nodeCount() < 2) return false;
+		const int MAX_NODES = 1024;
+		const int BITS = 8 * sizeof(unsigned long);
+		unsigned long mask[MAX_NODES / BITS] = { 0 };
+		for (const Node & node : nodes()) {
+			if (node.id < MAX_NODES) mask[node.id / BITS] |= 1ul << (node.id % BITS);
+		}
+		const int MPOL_INTERLEAVE_POLICY = 3; //MPOL_INTERLEAVE from linux/mempolicy.h
+		return syscall(SYS_mbind, memory, size, MPOL_INTERLEAVE_POLICY, mask, MAX_NODES, 0) == 0;
+	}
+
+#else
+
+	int nodeCount() { return 1; }
+	void bindThisThread(size_t) {}
+	bool interleave(void *, size_t) { return false; }
+
+#endif
+
+}
+
 namespace WinProcGroup {
 
 #ifndef _WIN32
 
-	void bindThisThread(size_t) {}
+	void bindThisThread(size_t idx) { numa::bindThisThread(idx); }
 
 #else
 
@@ -281,16 +387,17 @@ namespace utils {
 	{
 		std::ifstream paramfile(parameter);
 		std::vector<std::string> vparam;
+		bool materialChanged = false;
 		for (std::string line; getline(paramfile, line); )
 		{
 			std::size_t found = line.find("=");
 			if (found != std::string::npos) {
 				if (found == 1 && !line.substr(0, found).compare("K")) K = std::stod(line.substr(found + 1));
 				else
-				settings::parameter.setParam(line.substr(0, found), line.substr(found + 1));
+				materialChanged = settings::parameter.setParam(line.substr(0, found), line.substr(found + 1)) || materialChanged;
 			}
 		}
-		InitializeMaterialTable();
+		if (materialChanged) InitializeMaterialTable();
 		settings::parameter.HelperThreads = 0;
 		int packageCount = (int)std::thread::hardware_concurrency() - 1;
 		//int packageCount = 1;
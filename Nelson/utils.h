@@ -18,6 +18,17 @@ namespace WinProcGroup {
 	void bindThisThread(size_t idx);
 }
 
+/// On Linux multi-socket systems threads are bound to the CPUs of one NUMA node (threads are
+/// distributed round-robin over the nodes) and shared memory can be interleaved over all nodes.
+/// This is only done, if NUMA mode is enabled (settings::parameter.UseNuma). If it is disabled,
+/// bound threads get back the affinity the process started with. On other platforms these
+/// functions do nothing.
+namespace numa {
+	int nodeCount();
+	void bindThisThread(size_t idx);
+	bool interleave(void * memory, size_t size);
+}
+
 namespace utils {
 
 	void debugInfo(std::string info);
@@ -64,6 +75,7 @@ namespace utils {
 #define SCORE_FINAL(score) score
 #define SCORE_SP(score) score
 #define SCORE_DP(score) score
+#define SCORE_REP(score) score
 
 }
 